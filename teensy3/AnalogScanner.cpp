@@ -0,0 +1,206 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "AnalogScanner.h"
+#include "core_pins.h"
+#include <math.h>
+
+#if defined(KINETISK)
+
+bool AnalogScanner::begin(const uint8_t *pins, uint8_t num)
+{
+	uint8_t order[2][ANALOG_SCANNER_MAX_PINS];
+#ifdef HAS_KINETIS_ADC1
+	int mux = -1;
+#endif
+
+	end();
+	if (num == 0 || num > ANALOG_SCANNER_MAX_PINS) return false;
+	chain[0].count = 0;
+#ifdef HAS_KINETIS_ADC1
+	chain[1].count = 0;
+#endif
+	for (uint8_t i=0; i < num; i++) {
+		uint8_t ch = analog_pin_to_sc1a(pins[i]);
+		if (ch == 255) return false;
+		uint8_t adc = 0;
+#ifdef HAS_KINETIS_ADC1
+		if (ch & 0x80) {
+			// ADC1 a/b channel select is per ADC, not per conversion
+			if (mux >= 0 && mux != (ch & 0x40)) return false;
+			mux = ch & 0x40;
+			adc = 1;
+		}
+#endif
+		Chain &c = chain[adc];
+		order[adc][c.count] = ch & 0x3F;
+		where[i] = (adc << 7) | c.count;
+		c.values[c.count] = 0;
+		c.count++;
+	}
+	count = num;
+	int full = (1 << analog_resolution()) - 1;
+	for (uint8_t i=0; i < num; i++) {
+		axis[i].lut = NULL;
+		calibrate(i, 0, (full + 1) / 2, full);
+	}
+	// waits for calibration and sets up ADC1's channel select
+	analogRead(pins[0]);
+	for (uint8_t i=0; i < num; i++) {
+		if (where[i] & 0x80) {
+			analogRead(pins[i]);
+			break;
+		}
+	}
+	if (chain[0].count) {
+		startChain(chain[0], ADC0_SC1A, ADC0_RA, ADC0_SC2, DMAMUX_SOURCE_ADC0, order[0]);
+	}
+#ifdef HAS_KINETIS_ADC1
+	if (chain[1].count) {
+		startChain(chain[1], ADC1_SC1A, ADC1_RA, ADC1_SC2, DMAMUX_SOURCE_ADC1, order[1]);
+	}
+#endif
+	running = true;
+	return true;
+}
+
+bool AnalogScanner::startChain(Chain &c, volatile uint32_t &sc1a_reg, volatile uint32_t &ra_reg,
+	volatile uint32_t &sc2_reg, uint8_t source, const uint8_t *order)
+{
+	for (uint8_t i=0; i < c.count; i++) {
+		c.sc1a[i] = order[(i + 1) % c.count];
+	}
+	c.result.source(*(volatile const uint16_t *)&ra_reg);
+	c.result.destinationBuffer(c.values, c.count * 2);
+	c.result.triggerAtHardwareEvent(source);
+	c.command.sourceBuffer(c.sc1a, c.count * 4);
+	c.command.destination(sc1a_reg);
+	// start the next conversion after every result, including the
+	// one that wraps around
+	c.command.triggerAtTransfersOf(c.result);
+	c.command.triggerAtCompletionOf(c.result);
+	c.result.enable();
+	sc2_reg |= ADC_SC2_DMAEN;
+	sc1a_reg = order[0];
+	return true;
+}
+
+void AnalogScanner::end(void)
+{
+	if (!running) return;
+	if (chain[0].count) {
+		chain[0].result.disable();
+		ADC0_SC2 &= ~ADC_SC2_DMAEN;
+		ADC0_SC1A = ADC_SC1_ADCH(31);
+	}
+#ifdef HAS_KINETIS_ADC1
+	if (chain[1].count) {
+		chain[1].result.disable();
+		ADC1_SC2 &= ~ADC_SC2_DMAEN;
+		ADC1_SC1A = ADC_SC1_ADCH(31);
+	}
+#endif
+	running = false;
+}
+
+void AnalogScanner::calibrate(uint8_t index, uint16_t min, uint16_t center, uint16_t max,
+	uint16_t deadzone)
+{
+	if (index >= count) return;
+	Axis &a = axis[index];
+	int hi = max - center - deadzone;
+	int lo = center - min - deadzone;
+	if (hi < 1) hi = 1;
+	a.center = center;
+	a.deadzone = deadzone;
+	a.range_hi = hi;
+	if (center == min) {
+		// trigger, the whole range goes to 0-255
+		a.range_lo = 0;
+		a.scale_hi = (255 << 16) / hi;
+		a.scale_lo = 0;
+	} else {
+		if (lo < 1) lo = 1;
+		a.range_lo = lo;
+		a.scale_hi = (127 << 16) / hi;
+		a.scale_lo = (128 << 16) / lo;
+	}
+}
+
+void AnalogScanner::curve(uint8_t index, const uint8_t *lut)
+{
+	if (index >= count) return;
+	axis[index].lut = lut;
+}
+
+uint8_t AnalogScanner::read(uint8_t index) const
+{
+	if (index >= count) return 0;
+	const Axis &a = axis[index];
+	int v = (int)raw(index) - a.center;
+	uint32_t d;
+	uint8_t x;
+
+	if (a.range_lo == 0) {
+		if (v > a.deadzone) {
+			d = v - a.deadzone;
+			if (d > a.range_hi) d = a.range_hi;
+			x = (d * a.scale_hi) >> 16;
+		} else {
+			x = 0;
+		}
+	} else if (v > a.deadzone) {
+		d = v - a.deadzone;
+		if (d > a.range_hi) d = a.range_hi;
+		x = 128 + ((d * a.scale_hi) >> 16);
+	} else if (v < -a.deadzone) {
+		d = -v - a.deadzone;
+		if (d > a.range_lo) d = a.range_lo;
+		x = 128 - ((d * a.scale_lo) >> 16);
+	} else {
+		x = 128;
+	}
+	return a.lut ? a.lut[x] : x;
+}
+
+void AnalogScanner::buildCurve(uint8_t *lut, float exponent, bool centered)
+{
+	for (int i=0; i < 256; i++) {
+		if (centered) {
+			float d = (i >= 128) ? (i - 128) / 127.0f : (128 - i) / 128.0f;
+			float y = powf(d, exponent);
+			lut[i] = (i >= 128) ? 128 + (int)(y * 127.0f + 0.5f) : 128 - (int)(y * 128.0f + 0.5f);
+		} else {
+			lut[i] = (int)(powf(i / 255.0f, exponent) * 255.0f + 0.5f);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef AnalogScanner_h_
+#define AnalogScanner_h_
+
+#include "kinetis.h"
+#include "DMAChannel.h"
+
+#if defined(KINETISK) && defined(__cplusplus)
+
+#ifndef ANALOG_SCANNER_MAX_PINS
+#define ANALOG_SCANNER_MAX_PINS 8
+#endif
+
+// Converts a list of analog pins round robin in the background.  Each ADC
+// is driven by two linked DMA channels: one stores the result when a
+// conversion completes and triggers the other, which starts the next one.
+// Nothing runs on the CPU and the latest values are read without waiting.
+//
+//   const uint8_t pins[] = {A0, A1, A2, A3, A10, A11};
+//   AnalogScanner sticks;
+//   sticks.begin(pins, sizeof(pins));
+//   sticks.calibrate(0, 40, 505, 990, 12);
+//   ...
+//   DS4.setLeftAnalog(sticks.read(0), sticks.read(1));
+//
+// The resolution and averaging set with analogReadResolution() and
+// analogReadAveraging() apply.  analogRead() must not be used on an ADC
+// while it is being scanned.
+class AnalogScanner {
+public:
+	AnalogScanner() {}
+	~AnalogScanner() { end(); }
+	bool begin(const uint8_t *pins, uint8_t count);
+	void end(void);
+	// Latest conversion of pins[index], in ADC counts
+	uint16_t raw(uint8_t index) const {
+		if (index >= count) return 0;
+		return chain[where[index] >> 7].values[where[index] & 0x7F];
+	}
+	// Latest value mapped through calibration and curve, 0 to 255.  Sticks
+	// rest at 128, triggers (center == min) at 0.
+	uint8_t read(uint8_t index) const;
+	// In ADC counts.  Readings within deadzone of center are at rest.
+	void calibrate(uint8_t index, uint16_t min, uint16_t center, uint16_t max,
+		uint16_t deadzone = 0);
+	// Response curve applied after calibration, 256 entries which must stay
+	// valid while in use.  NULL for linear.
+	void curve(uint8_t index, const uint8_t *lut);
+	// Fills a curve LUT with |x|^exponent, around 128 when centered
+	static void buildCurve(uint8_t *lut, float exponent, bool centered = true);
+private:
+	struct Chain {
+		DMAChannel result;
+		DMAChannel command;
+		volatile uint16_t values[ANALOG_SCANNER_MAX_PINS];
+		uint32_t sc1a[ANALOG_SCANNER_MAX_PINS]; // next conversion, rotated by one
+		uint8_t count;
+	};
+	struct Axis {
+		uint16_t center;
+		uint16_t deadzone;
+		uint16_t range_hi; // counts from the dead zone edge to max
+		uint16_t range_lo; // and to min, 0 for triggers
+		uint32_t scale_hi; // 16.16 output per count
+		uint32_t scale_lo;
+		const uint8_t *lut;
+	};
+	bool startChain(Chain &c, volatile uint32_t &sc1a_reg, volatile uint32_t &ra_reg,
+		volatile uint32_t &sc2_reg, uint8_t source, const uint8_t *order);
+#ifdef HAS_KINETIS_ADC1
+	Chain chain[2];
+#else
+	Chain chain[1];
+#endif
+	Axis axis[ANALOG_SCANNER_MAX_PINS];
+	uint8_t where[ANALOG_SCANNER_MAX_PINS]; // ADC << 7 | slot
+	uint8_t count = 0;
+	bool running = false;
+};
+
+#endif
+#endif
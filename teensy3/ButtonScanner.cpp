@@ -0,0 +1,116 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ButtonScanner.h"
+
+#if defined(KINETISK)
+
+ButtonScanner *ButtonScanner::scanners[4];
+
+bool ButtonScanner::begin(volatile uint32_t &port, uint32_t mask, bool activeLow, uint32_t rate)
+{
+	end();
+	// DMAMUX periodic triggers only exist on channels 0 to 3
+	if (rate == 0 || dma.channel >= 4) return false;
+	SIM_SCGC6 |= SIM_SCGC6_PIT;
+	__asm__ volatile("nop"); // solves timing problem on Teensy 3.5
+	PIT_MCR = 1;
+	KINETISK_PIT_CHANNEL_t *ch = KINETISK_PIT_CHANNELS + dma.channel;
+	if (ch->TCTRL != 0) return false; // in use by an IntervalTimer
+
+	this->mask = mask;
+	this->activeLow = activeLow;
+	state = port;
+	cnt0 = 0;
+	cnt1 = 0;
+	pressed = (activeLow ? ~state : state) & mask;
+	scanners[dma.channel] = this;
+
+	dma.source(port);
+	dma.destinationBuffer(buffer, sizeof(buffer));
+	dma.interruptAtHalf();
+	dma.interruptAtCompletion();
+	dma.attachInterrupt(isr);
+	dma.triggerContinuously();
+	*((volatile uint8_t *)&DMAMUX0_CHCFG0 + dma.channel) |= DMAMUX_TRIG;
+	dma.enable();
+	ch->LDVAL = F_BUS / rate - 1;
+	ch->TCTRL = 1; // run without interrupts, setting TCTRL also claims it
+	pit = ch;
+	return true;
+}
+
+void ButtonScanner::end(void)
+{
+	if (!pit) return;
+	pit->TCTRL = 0;
+	dma.disable();
+	dma.detachInterrupt();
+	*((volatile uint8_t *)&DMAMUX0_CHCFG0 + dma.channel) = 0;
+	scanners[dma.channel] = nullptr;
+	pit = nullptr;
+}
+
+void ButtonScanner::process(const volatile uint32_t *samples)
+{
+	uint32_t all = 0xFFFFFFFF, any = 0;
+	for (int i=0; i < BUTTON_SCANNER_BATCH; i++) {
+		all &= samples[i];
+		any |= samples[i];
+	}
+	// pins that held the opposite level of their state for the whole batch
+	// count up, anything else resets its counter
+	uint32_t delta = ((all & ~state) | (~any & state)) & mask;
+	cnt1 = (cnt1 ^ cnt0) & delta;
+	cnt0 = ~cnt0 & delta;
+	uint32_t toggle = delta & ~(cnt0 | cnt1);
+	if (toggle) {
+		state ^= toggle;
+		pressed = (activeLow ? ~state : state) & mask;
+		count++;
+	}
+}
+
+void ButtonScanner::isr(void)
+{
+	uint32_t ipsr;
+	__asm__ volatile("mrs %0, ipsr\n" : "=r" (ipsr)::);
+	ButtonScanner *s = scanners[(ipsr - 16 - IRQ_DMA_CH0) & 3];
+	if (!s) return;
+	s->dma.clearInterrupt();
+	// the channel is filling the half that didn't just complete
+	if (s->dma.TCD->CITER > BUTTON_SCANNER_BATCH) {
+		s->process(s->buffer + BUTTON_SCANNER_BATCH);
+	} else {
+		s->process(s->buffer);
+	}
+}
+
+#endif
@@ -0,0 +1,92 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ButtonScanner_h_
+#define ButtonScanner_h_
+
+#include "kinetis.h"
+#include "DMAChannel.h"
+
+#if defined(KINETISK) && defined(__cplusplus)
+
+// Samples per second of the port, each sample is one DMA transfer
+#ifndef BUTTON_SCANNER_RATE
+#define BUTTON_SCANNER_RATE 8000
+#endif
+
+// Samples per debounce tick. A button changes after holding its new level
+// for 4 whole ticks, 2 ms with the defaults.
+#ifndef BUTTON_SCANNER_BATCH
+#define BUTTON_SCANNER_BATCH 4
+#endif
+
+// Reads a whole GPIO port at a fixed rate with a PIT triggered DMA channel
+// and debounces all 32 pins at once with vertical counters.  The CPU only
+// runs once per batch, from the DMA interrupt.
+//
+//   ButtonScanner buttons;
+//   buttons.begin(GPIOD_PDIR, 0xff);
+//   ...
+//   DS4.setButtons<MyMap>(buttons.read());
+//
+// The DMA channel must be one of 0-3 (the ones with periodic triggers) and
+// the matching PIT must not be used by an IntervalTimer, so create the
+// scanner before other DMA users and call begin() early.
+class ButtonScanner {
+public:
+	ButtonScanner() {}
+	~ButtonScanner() { end(); }
+	// port is a GPIOx_PDIR register, pins are set up with pinMode() first.
+	// With activeLow, a pin reads as pressed when low (INPUT_PULLUP).
+	bool begin(volatile uint32_t &port, uint32_t mask, bool activeLow = true,
+		uint32_t rate = BUTTON_SCANNER_RATE);
+	void end(void);
+	// Debounced pressed buttons, one bit per port pin.  Written with a
+	// single store, so it can be read from any context.
+	uint32_t read(void) const { return pressed; }
+	// Incremented every time read() changes
+	uint32_t changes(void) const { return count; }
+private:
+	void process(const volatile uint32_t *samples);
+	static void isr(void);
+	DMAChannel dma;
+	KINETISK_PIT_CHANNEL_t *pit = nullptr;
+	volatile uint32_t buffer[BUTTON_SCANNER_BATCH * 2];
+	uint32_t mask = 0;
+	bool activeLow = true;
+	uint32_t state = 0; // debounced levels
+	uint32_t cnt0 = 0, cnt1 = 0; // vertical counter bits
+	volatile uint32_t pressed = 0;
+	volatile uint32_t count = 0;
+	static ButtonScanner *scanners[4];
+};
+
+#endif
+#endif
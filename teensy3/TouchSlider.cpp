@@ -0,0 +1,184 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TouchSlider.h"
+#include "core_pins.h"
+
+#if defined(HAS_KINETIS_TSI) || defined(HAS_KINETIS_TSI_LITE)
+
+#if defined(HAS_KINETIS_TSI)
+#define CURRENT   2 // same as touchRead()
+#endif
+#define PRESCALE  2
+
+TouchSlider *TouchSlider::active = NULL;
+
+bool TouchSlider::begin(const uint8_t *pins, uint8_t num, uint16_t thresh, uint16_t outrange)
+{
+	if (active) active->end();
+	if (num == 0 || num > TOUCH_SLIDER_MAX || outrange == 0 || outrange > 4096) return false;
+	for (uint8_t i=0; i < num; i++) {
+		uint8_t ch = touch_pin_to_channel(pins[i]);
+		if (ch == 255) return false;
+		channel[i] = ch;
+	}
+	for (uint8_t i=0; i < num; i++) {
+		*portConfigRegister(pins[i]) = PORT_PCR_MUX(0);
+	}
+	count = num;
+	current = 0;
+	threshold = thresh;
+	range = outrange;
+	contacts = 0;
+	frame_count = 0;
+	active = this;
+	SIM_SCGC5 |= SIM_SCGC5_TSI;
+#if defined(HAS_KINETIS_TSI)
+	// one scan measures every pad, one interrupt per frame
+	uint32_t pen = 0;
+	for (uint8_t i=0; i < num; i++) pen |= 1 << channel[i];
+	TSI0_GENCS = 0;
+	TSI0_PEN = pen;
+	TSI0_SCANC = TSI_SCANC_REFCHRG(3) | TSI_SCANC_EXTCHRG(CURRENT);
+	config = TSI_GENCS_NSCN(TOUCH_SLIDER_NSCAN) | TSI_GENCS_PS(PRESCALE)
+		| TSI_GENCS_TSIEN | TSI_GENCS_TSIIE | TSI_GENCS_ESOR;
+	TSI0_GENCS = config;
+	NVIC_ENABLE_IRQ(IRQ_TSI);
+	TSI0_GENCS = config | TSI_GENCS_SWTS;
+#else
+	// one pad per scan, the interrupt starts the next
+	config = TSI_GENCS_REFCHRG(4) | TSI_GENCS_EXTCHRG(3) | TSI_GENCS_PS(PRESCALE)
+		| TSI_GENCS_NSCN(TOUCH_SLIDER_NSCAN) | TSI_GENCS_TSIEN | TSI_GENCS_TSIIEN
+		| TSI_GENCS_ESOR;
+	TSI0_GENCS = config | TSI_GENCS_EOSF;
+	NVIC_ENABLE_IRQ(IRQ_TSI);
+	TSI0_DATA = TSI_DATA_TSICH(channel[0]) | TSI_DATA_SWTS;
+#endif
+	return true;
+}
+
+void TouchSlider::end(void)
+{
+	if (active != this) return;
+	NVIC_DISABLE_IRQ(IRQ_TSI);
+	TSI0_GENCS = 0;
+	active = NULL;
+}
+
+void TouchSlider::scanned(void)
+{
+#if defined(HAS_KINETIS_TSI)
+	TSI0_GENCS = config | TSI_GENCS_EOSF;
+	for (uint8_t i=0; i < count; i++) {
+		counts[i] = *((volatile uint16_t *)(&TSI0_CNTR1) + channel[i]);
+	}
+	frame();
+	TSI0_GENCS = config | TSI_GENCS_SWTS;
+#else
+	TSI0_GENCS = config | TSI_GENCS_EOSF;
+	counts[current] = TSI0_DATA & 0xFFFF;
+	if (++current >= count) {
+		current = 0;
+		frame();
+	}
+	TSI0_DATA = TSI_DATA_TSICH(channel[current]) | TSI_DATA_SWTS;
+#endif
+}
+
+void TouchSlider::frame(void)
+{
+	uint32_t sum = 0, moment = 0;
+	uint32_t strength[2] = {0, 0};
+	uint32_t pos[2] = {0, 0};
+	uint8_t n = 0;
+
+	for (uint8_t i=0; i <= count; i++) {
+		int32_t d = 0;
+		if (i < count) {
+			int32_t raw = counts[i];
+			if (frame_count == 0) base[i] = raw << 8;
+			d = raw - (int32_t)(base[i] >> 8);
+			if (d < 0) {
+				// a finger at power up leaves the baseline high, come down fast
+				base[i] += ((raw << 8) - (int32_t)base[i]) >> 2;
+			} else if (d < threshold) {
+				base[i] += ((raw << 8) - (int32_t)base[i]) >> TOUCH_SLIDER_DRIFT;
+			}
+			if (d < threshold) d = 0;
+		}
+		if (d > 0) {
+			sum += d;
+			moment += i * d;
+		} else if (sum > 0) {
+			// end of a run, keep the two strongest
+			uint32_t x = (moment << 8) / sum; // pad index, 24.8
+			if (sum > strength[0]) {
+				strength[1] = strength[0];
+				pos[1] = pos[0];
+				strength[0] = sum;
+				pos[0] = x;
+			} else if (sum > strength[1]) {
+				strength[1] = sum;
+				pos[1] = x;
+			}
+			if (n < 2) n++;
+			sum = 0;
+			moment = 0;
+		}
+	}
+	for (uint8_t i=0; i < n; i++) {
+		pos[i] = (count > 1) ? pos[i] * (range - 1) / ((count - 1) << 8) : 0;
+	}
+	// keep the first contact on the finger that was there already
+	uint32_t prev = contacts;
+	if (n == 2 && (prev >> 24) > 0) {
+		int32_t p0 = prev & 0xFFF;
+		int32_t d0 = (int32_t)pos[0] - p0, d1 = (int32_t)pos[1] - p0;
+		if (d1 * d1 < d0 * d0) {
+			uint32_t tmp = pos[0];
+			pos[0] = pos[1];
+			pos[1] = tmp;
+		}
+	}
+	contacts = ((uint32_t)n << 24) | (pos[1] << 12) | pos[0];
+	frame_count++;
+}
+
+void tsi0_isr(void)
+{
+	TouchSlider *s = TouchSlider::active;
+	if (s) {
+		s->scanned();
+	} else {
+		TSI0_GENCS = TSI0_GENCS; // clear flags
+	}
+}
+
+#endif
@@ -0,0 +1,108 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TouchSlider_h_
+#define TouchSlider_h_
+
+#include "kinetis.h"
+
+#if (defined(HAS_KINETIS_TSI) || defined(HAS_KINETIS_TSI_LITE)) && defined(__cplusplus)
+
+#ifndef TOUCH_SLIDER_MAX
+#define TOUCH_SLIDER_MAX 16
+#endif
+// Scans per channel measurement, minus 1.  touchRead() uses 9, fewer is
+// faster and noisier.  With 3, 8 pads of ~30 pF measure in well under 1 ms.
+#ifndef TOUCH_SLIDER_NSCAN
+#define TOUCH_SLIDER_NSCAN 3
+#endif
+// Output positions are 0 to range - 1, by default the DS4 touchpad width
+#ifndef TOUCH_SLIDER_RANGE
+#define TOUCH_SLIDER_RANGE 1920
+#endif
+// Untouched baselines follow slow drift with a 1/2^n low pass
+#ifndef TOUCH_SLIDER_DRIFT
+#define TOUCH_SLIDER_DRIFT 8
+#endif
+
+extern "C" void tsi0_isr(void);
+
+// Scans a row of touch pads in the background, one TSI scan after another
+// from the end-of-scan interrupt, and finds up to two contacts along it.
+// Each contact is the centroid of a run of pads above threshold, so the
+// position resolution is much finer than the pad pitch.
+//
+//   const uint8_t pads[] = {0, 1, 15, 16, 17, 18, 19, 22, 23};
+//   TouchSlider slider;
+//   slider.begin(pads, sizeof(pads), 200);
+//   ...
+//   uint16_t x[2];
+//   DS4.setTouchContacts(slider.read(x), x, 471);
+//
+// Pads are in slider order.  Only one TouchSlider can run at a time and
+// touchRead() must not be used while it does.
+class TouchSlider {
+public:
+	TouchSlider() {}
+	~TouchSlider() { end(); }
+	// threshold is in touchRead() units above the untouched baseline
+	bool begin(const uint8_t *pins, uint8_t count, uint16_t threshold,
+		uint16_t range = TOUCH_SLIDER_RANGE);
+	void end(void);
+	// Number of contacts (0 to 2), their positions are stored in pos[]
+	uint8_t read(uint16_t *pos) const {
+		uint32_t w = contacts;
+		pos[0] = w & 0xFFF;
+		pos[1] = (w >> 12) & 0xFFF;
+		return w >> 24;
+	}
+	uint16_t raw(uint8_t index) const { return index < count ? counts[index] : 0; }
+	uint16_t baseline(uint8_t index) const { return index < count ? base[index] >> 8 : 0; }
+	// Completed scans of all pads
+	uint32_t frames(void) const { return frame_count; }
+private:
+	friend void tsi0_isr(void);
+	void scanned(void);
+	void frame(void);
+	uint8_t channel[TOUCH_SLIDER_MAX];
+	volatile uint16_t counts[TOUCH_SLIDER_MAX];
+	uint32_t base[TOUCH_SLIDER_MAX]; // 24.8
+	uint8_t count = 0;
+	uint8_t current = 0;
+	uint16_t threshold = 0;
+	uint16_t range = TOUCH_SLIDER_RANGE;
+	uint32_t config = 0;
+	volatile uint32_t contacts = 0; // count << 24 | pos[1] << 12 | pos[0]
+	volatile uint32_t frame_count = 0;
+	static TouchSlider *active;
+};
+
+#endif
+#endif
@@ -428,6 +428,18 @@ static const uint8_t pin2sc1a[] = {
 #endif
 
 
+// For code driving the ADCs directly, like AnalogScanner: the SC1A channel
+// of a pin in the encoding above (255 if none) and the current resolution.
+uint8_t analog_pin_to_sc1a(uint8_t pin)
+{
+	if (pin >= sizeof(pin2sc1a)) return 255;
+	return pin2sc1a[pin];
+}
+
+uint8_t analog_resolution(void)
+{
+	return analog_config_bits;
+}
 
 // TODO: perhaps this should store the NVIC priority, so it works recursively?
 static volatile uint8_t analogReadBusyADC0 = 0;
@@ -2273,6 +2273,8 @@ void analogReadRes(unsigned int bits);
 static inline void analogReadResolution(unsigned int bits) { analogReadRes(bits); }
 void analogReadAveraging(unsigned int num);
 void analog_init(void);
+uint8_t analog_pin_to_sc1a(uint8_t pin);
+uint8_t analog_resolution(void);
 
 
 #if defined(__MK20DX128__) || defined(__MK20DX256__) || defined(__MK64FX512__) || defined(__MK66FX1M0__)
@@ -2290,6 +2292,7 @@ void analog_init(void);
 
 
 int touchRead(uint8_t pin);
+uint8_t touch_pin_to_channel(uint8_t pin);
 
 
 static inline void shiftOut(uint8_t, uint8_t, uint8_t, uint8_t) __attribute__((always_inline, unused));
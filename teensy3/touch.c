@@ -73,6 +73,13 @@ static const uint8_t pin2tsi[] = {
 #endif
 
 
+// TSI channel of a pin, 255 if it can't do touch sensing
+uint8_t touch_pin_to_channel(uint8_t pin)
+{
+	if (pin >= NUM_DIGITAL_PINS || pin >= sizeof(pin2tsi)) return 255;
+	return pin2tsi[pin];
+}
+
 // output is approx pF * 50
 // time to measure 33 pF is approx 0.25 ms
 // time to measure 1000 pF is approx 4.5 ms
@@ -114,6 +121,11 @@ int touchRead(uint8_t pin)
         return 0; // no Touch sensing :(
 }
 
+uint8_t touch_pin_to_channel(uint8_t pin)
+{
+	return 255;
+}
+
 #endif
 
 
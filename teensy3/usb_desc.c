@@ -164,6 +164,36 @@ static uint8_t keyboard_report_desc[] = {
 };
 #endif
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+// N-key rollover: modifier byte, then one bit for each key usage 0 to 223
+static uint8_t keyboard_nkro_report_desc[] = {
+        0x05, 0x01,                     // Usage Page (Generic Desktop),
+        0x09, 0x06,                     // Usage (Keyboard),
+        0xA1, 0x01,                     // Collection (Application),
+        0x75, 0x01,                     //   Report Size (1),
+        0x95, 0x08,                     //   Report Count (8),
+        0x05, 0x07,                     //   Usage Page (Key Codes),
+        0x19, 0xE0,                     //   Usage Minimum (224),
+        0x29, 0xE7,                     //   Usage Maximum (231),
+        0x15, 0x00,                     //   Logical Minimum (0),
+        0x25, 0x01,                     //   Logical Maximum (1),
+        0x81, 0x02,                     //   Input (Data, Variable, Absolute), ;Modifier keys
+        0x95, 0xE0,                     //   Report Count (224),
+        0x19, 0x00,                     //   Usage Minimum (0),
+        0x29, 0xDF,                     //   Usage Maximum (223),
+        0x81, 0x02,                     //   Input (Data, Variable, Absolute), ;Key bitmap
+        0x95, 0x05,                     //   Report Count (5),
+        0x05, 0x08,                     //   Usage Page (LEDs),
+        0x19, 0x01,                     //   Usage Minimum (1),
+        0x29, 0x05,                     //   Usage Maximum (5),
+        0x91, 0x02,                     //   Output (Data, Variable, Absolute), ;LED report
+        0x95, 0x01,                     //   Report Count (1),
+        0x75, 0x03,                     //   Report Size (3),
+        0x91, 0x03,                     //   Output (Constant),         ;LED report padding
+        0xC0                            // End Collection
+};
+#endif
+
 #ifdef KEYMEDIA_INTERFACE
 static uint8_t keymedia_report_desc[] = {
         0x05, 0x0C,                     // Usage Page (Consumer)
@@ -660,7 +690,15 @@ static uint8_t ds4_report_desc[] = {
 #define KEYMEDIA_INTERFACE_DESC_SIZE	0
 #endif
 
-#define AUDIO_INTERFACE_DESC_POS	KEYMEDIA_INTERFACE_DESC_POS+KEYMEDIA_INTERFACE_DESC_SIZE
+#define KEYBOARD_NKRO_INTERFACE_DESC_POS	KEYMEDIA_INTERFACE_DESC_POS+KEYMEDIA_INTERFACE_DESC_SIZE
+#ifdef  KEYBOARD_NKRO_INTERFACE
+#define KEYBOARD_NKRO_INTERFACE_DESC_SIZE	9+9+7
+#define KEYBOARD_NKRO_HID_DESC_OFFSET	KEYBOARD_NKRO_INTERFACE_DESC_POS+9
+#else
+#define KEYBOARD_NKRO_INTERFACE_DESC_SIZE	0
+#endif
+
+#define AUDIO_INTERFACE_DESC_POS	KEYBOARD_NKRO_INTERFACE_DESC_POS+KEYBOARD_NKRO_INTERFACE_DESC_SIZE
 #ifdef  AUDIO_INTERFACE
 #define AUDIO_INTERFACE_DESC_SIZE	8 + 9+10+12+9+12+10+9 + 9+9+7+11+9+7 + 9+9+7+11+9+7+9
 #else
@@ -1415,6 +1453,35 @@ static uint8_t config_descriptor[CONFIG_DESC_SIZE] = {
         KEYMEDIA_INTERVAL,                      // bInterval
 #endif // KEYMEDIA_INTERFACE
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+        // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
+        9,                                      // bLength
+        4,                                      // bDescriptorType
+        KEYBOARD_NKRO_INTERFACE,                // bInterfaceNumber
+        0,                                      // bAlternateSetting
+        1,                                      // bNumEndpoints
+        0x03,                                   // bInterfaceClass (0x03 = HID)
+        0x00,                                   // bInterfaceSubClass
+        0x00,                                   // bInterfaceProtocol
+        0,                                      // iInterface
+        // HID interface descriptor, HID 1.11 spec, section 6.2.1
+        9,                                      // bLength
+        0x21,                                   // bDescriptorType
+        0x11, 0x01,                             // bcdHID
+        0,                                      // bCountryCode
+        1,                                      // bNumDescriptors
+        0x22,                                   // bDescriptorType
+        LSB(sizeof(keyboard_nkro_report_desc)), // wDescriptorLength
+        MSB(sizeof(keyboard_nkro_report_desc)),
+        // endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13
+        7,                                      // bLength
+        5,                                      // bDescriptorType
+        KEYBOARD_NKRO_ENDPOINT | 0x80,          // bEndpointAddress
+        0x03,                                   // bmAttributes (0x03=intr)
+        KEYBOARD_NKRO_SIZE, 0,                  // wMaxPacketSize
+        KEYBOARD_NKRO_INTERVAL,                 // bInterval
+#endif // KEYBOARD_NKRO_INTERFACE
+
 #ifdef AUDIO_INTERFACE
         // interface association descriptor, USB ECN, Table 9-Z
         8,                                      // bLength
@@ -1826,6 +1893,10 @@ const usb_descriptor_list_t usb_descriptor_list[] = {
         {0x2200, KEYMEDIA_INTERFACE, keymedia_report_desc, sizeof(keymedia_report_desc)},
         {0x2100, KEYMEDIA_INTERFACE, config_descriptor+KEYMEDIA_HID_DESC_OFFSET, 9},
 #endif
+#ifdef KEYBOARD_NKRO_INTERFACE
+        {0x2200, KEYBOARD_NKRO_INTERFACE, keyboard_nkro_report_desc, sizeof(keyboard_nkro_report_desc)},
+        {0x2100, KEYBOARD_NKRO_INTERFACE, config_descriptor+KEYBOARD_NKRO_HID_DESC_OFFSET, 9},
+#endif
 #ifdef MULTITOUCH_INTERFACE
         {0x2200, MULTITOUCH_INTERFACE, multitouch_report_desc, sizeof(multitouch_report_desc)},
         {0x2100, MULTITOUCH_INTERFACE, config_descriptor+MULTITOUCH_HID_DESC_OFFSET, 9},
@@ -81,7 +81,9 @@ Edit NUM_USB_BUFFERS to control how much memory the USB stack will
 allocate.  At least 2 should be used for each endpoint.  More
 memory will allow higher throughput for user programs that have
 high latency (eg, spending time doing things other than interacting
-with the USB).
+with the USB).  Up to 1024 buffers may be used.  An endpoint can
+have buffers set aside with usb_mem_reserve(), so other endpoints
+can't use them all.
 
 Edit the ENDPOINT*_CONFIG lines so each endpoint is configured
 the proper way (transmit, receive, or both).
@@ -254,6 +256,42 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define ENDPOINT5_CONFIG	ENDPOINT_TRANSMIT_ONLY
   #define ENDPOINT6_CONFIG	ENDPOINT_TRANSMIT_ONLY
 
+#elif defined(USB_KEYBOARD_NKRO)
+  #define VENDOR_ID		0x16C0
+  #define PRODUCT_ID		0x04D0
+  #define MANUFACTURER_NAME	{'T','e','e','n','s','y','d','u','i','n','o'}
+  #define MANUFACTURER_NAME_LEN	11
+  #define PRODUCT_NAME		{'K','e','y','b','o','a','r','d'}
+  #define PRODUCT_NAME_LEN	8
+  #define EP0_SIZE		64
+  #define NUM_ENDPOINTS         5
+  #define NUM_USB_BUFFERS	15
+  #define NUM_INTERFACE		4
+  #define SEREMU_INTERFACE      1	// Serial emulation
+  #define SEREMU_TX_ENDPOINT    1
+  #define SEREMU_TX_SIZE        64
+  #define SEREMU_TX_INTERVAL    1
+  #define SEREMU_RX_ENDPOINT    2
+  #define SEREMU_RX_SIZE        32
+  #define SEREMU_RX_INTERVAL    2
+  #define KEYBOARD_INTERFACE    0	// Keyboard, boot protocol 6KRO
+  #define KEYBOARD_ENDPOINT     3
+  #define KEYBOARD_SIZE         8
+  #define KEYBOARD_INTERVAL     1
+  #define KEYMEDIA_INTERFACE    2	// Keyboard Media Keys
+  #define KEYMEDIA_ENDPOINT     4
+  #define KEYMEDIA_SIZE         8
+  #define KEYMEDIA_INTERVAL     4
+  #define KEYBOARD_NKRO_INTERFACE 3	// Keyboard, N-key rollover bitmap
+  #define KEYBOARD_NKRO_ENDPOINT  5
+  #define KEYBOARD_NKRO_SIZE      32
+  #define KEYBOARD_NKRO_INTERVAL  1
+  #define ENDPOINT1_CONFIG	ENDPOINT_TRANSMIT_ONLY
+  #define ENDPOINT2_CONFIG	ENDPOINT_RECEIVE_ONLY
+  #define ENDPOINT3_CONFIG	ENDPOINT_TRANSMIT_ONLY
+  #define ENDPOINT4_CONFIG	ENDPOINT_TRANSMIT_ONLY
+  #define ENDPOINT5_CONFIG	ENDPOINT_TRANSMIT_ONLY
+
 #elif defined(USB_HID)
   #define VENDOR_ID		0x16C0
   #define PRODUCT_ID		0x0482
@@ -964,6 +1002,7 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define DS4_INTERFACE      0	// DS4
   #define DS4_TX_ENDPOINT    1
   #define DS4_TX_SIZE        64
+  #define DS4_TX_RESERVE     2	// buffers only DS4 reports may use
   #define DS4_RX_ENDPOINT    2
   #define DS4_RX_SIZE        64
   #if defined(USB_DS4_TURBO) && USB_DS4_TURBO == 1
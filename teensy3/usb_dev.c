@@ -43,6 +43,9 @@
 #include "kinetis.h"
 //#include "HardwareSerial.h"
 #include "usb_mem.h"
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+#include "core_pins.h" // for micros
+#endif
 #include <string.h> // for memset
 
 // This code has a known bug with compiled with -O2 optimization on gcc 5.4.1
@@ -142,6 +145,19 @@ static uint8_t ep0_tx_bdt_bank = 0;
 static uint8_t ep0_tx_data_toggle = 0;
 uint8_t usb_rx_memory_needed = 0;
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+static usb_telemetry_t telemetry;
+static uint8_t tx_depth[NUM_ENDPOINTS];
+#if defined(KINETISK)
+#define TELEMETRY_NOW() ARM_DWT_CYCCNT
+#else
+#define TELEMETRY_NOW() micros()
+#endif
+#define TELEMETRY(x) (x)
+#else
+#define TELEMETRY(x)
+#endif
+
 volatile uint8_t usb_configuration = 0;
 volatile uint8_t usb_reboot_timer = 0;
 
@@ -187,6 +203,9 @@ static void usb_setup(void)
 	  case 0x0900: // SET_CONFIGURATION
 		//serial_print("configure\n");
 		usb_configuration = setup.wValue;
+#ifdef KEYBOARD_NKRO_INTERFACE
+		keyboard_protocol = 1;
+#endif
 		reg = &USB0_ENDPT1;
 		cfg = usb_endpoint_config_table;
 		// clear all BDT entries, free any allocated memory...
@@ -214,6 +233,7 @@ static void usb_setup(void)
 			}
 			tx_first[i] = NULL;
 			tx_last[i] = NULL;
+			TELEMETRY(tx_depth[i] = 0);
 			usb_rx_byte_count_data[i] = 0;
 			switch (tx_state[i]) {
 			  case TX_STATE_EVEN_FREE:
@@ -250,6 +270,7 @@ static void usb_setup(void)
 				} else {
 					table[index(i, RX, EVEN)].desc = 0;
 					usb_rx_memory_needed++;
+					TELEMETRY(telemetry.rx_starved++);
 				}
 				p = usb_malloc();
 				if (p) {
@@ -258,6 +279,7 @@ static void usb_setup(void)
 				} else {
 					table[index(i, RX, ODD)].desc = 0;
 					usb_rx_memory_needed++;
+					TELEMETRY(telemetry.rx_starved++);
 				}
 			}
 			table[index(i, TX, EVEN)].desc = 0;
@@ -413,10 +435,8 @@ static void usb_setup(void)
 		break;
 	  case 0x01A1: // HID GET_REPORT
 #if defined(USB_DS4)
-		// DS4: get feature report 0xf1, 0xf2 (getChallengeResponse, challengeResponseAvailable)
-		if (!usb_ds4_on_get_report(&setup, usb_ds4_reply_buffer, &datalen)) {
-			data = usb_ds4_reply_buffer;
-		} else {
+		// DS4: feature reports, data points at the reply
+		if (usb_ds4_on_get_report(&setup, &data, &datalen)) {
 			endpoint0_stall();
 			return;
 		}
@@ -434,6 +454,24 @@ static void usb_setup(void)
 	  // case 0xC940:
 #endif
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+	  case 0x0B21: // HID SET_PROTOCOL
+		// boot protocol hosts only understand the 6KRO keyboard
+		if (setup.wIndex == KEYBOARD_INTERFACE) {
+			keyboard_protocol = setup.wValue ? 1 : 0;
+		}
+		break;
+	  case 0x03A1: // HID GET_PROTOCOL
+		if (setup.wIndex != KEYBOARD_INTERFACE) {
+			endpoint0_stall();
+			return;
+		}
+		reply_buffer[0] = keyboard_protocol;
+		data = reply_buffer;
+		datalen = 1;
+		break;
+#endif
+
 #if defined(AUDIO_INTERFACE)
 	  case 0x0B01: // SET_INTERFACE (alternate setting)
 		if (setup.wIndex == AUDIO_INTERFACE+1) {
@@ -671,6 +709,12 @@ static void usb_control(uint32_t stat)
 			endpoint0_transmit(NULL, 0);
 		}
 #endif
+#ifdef KEYBOARD_NKRO_INTERFACE
+		if (setup.word1 == 0x02000921 && setup.word2 == ((1<<16)|KEYBOARD_NKRO_INTERFACE)) {
+			keyboard_leds = buf[0];
+			endpoint0_transmit(NULL, 0);
+		}
+#endif
 #ifdef SEREMU_INTERFACE
 		if (setup.word1 == 0x03000921 && setup.word2 == ((4<<16)|SEREMU_INTERFACE)
 		  && buf[0] == 0xA9 && buf[1] == 0x45 && buf[2] == 0xC2 && buf[3] == 0x6B) {
@@ -857,6 +901,20 @@ void usb_rx_memory(usb_packet_t *packet)
 //#define index(endpoint, tx, odd) (((endpoint) << 2) | ((tx) << 1) | (odd))
 //#define stat2bufferdescriptor(stat) (table + ((stat) >> 2))
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+// called with interrupts disabled
+static void telemetry_tx_depth(uint32_t endpoint, uint32_t depth)
+{
+	if (depth > telemetry.tx_depth_max[endpoint]) {
+		telemetry.tx_depth_max[endpoint] = depth;
+	}
+	if (depth >= USB_TELEMETRY_DEPTH_BUCKETS) {
+		depth = USB_TELEMETRY_DEPTH_BUCKETS - 1;
+	}
+	telemetry.tx_depth[endpoint][depth]++;
+}
+#endif
+
 void usb_tx(uint32_t endpoint, usb_packet_t *packet)
 {
 	bdt_t *b = &table[index(endpoint, TX, EVEN)];
@@ -890,15 +948,102 @@ void usb_tx(uint32_t endpoint, usb_packet_t *packet)
 			tx_last[endpoint]->next = packet;
 		}
 		tx_last[endpoint] = packet;
+		TELEMETRY(telemetry_tx_depth(endpoint, ++tx_depth[endpoint]));
 		__enable_irq();
 		return;
 	}
 	tx_state[endpoint] = next;
 	b->addr = packet->buf;
 	b->desc = BDT_DESC(packet->len, ((uint32_t)b & 8) ? DATA1 : DATA0);
+	TELEMETRY(telemetry_tx_depth(endpoint, 0));
 	__enable_irq();
 }
 
+// Returns 1 when the endpoint has nothing queued or being sent
+int usb_tx_idle(uint32_t endpoint)
+{
+	endpoint--;
+	if (endpoint >= NUM_ENDPOINTS) return 0;
+	return tx_state[endpoint] == TX_STATE_BOTH_FREE_EVEN_FIRST ||
+		tx_state[endpoint] == TX_STATE_BOTH_FREE_ODD_FIRST;
+}
+
+// Send a list of packets linked by their next pointers, in one critical
+// section.  Free buffer descriptors are filled from the head of the list
+// and the rest is appended to the software queue.
+void usb_tx_chain(uint32_t endpoint, usb_packet_t *packet)
+{
+	bdt_t *b;
+	usb_packet_t *next;
+	uint8_t state;
+
+	endpoint--;
+	if (endpoint >= NUM_ENDPOINTS || packet == NULL) return;
+	__disable_irq();
+	state = tx_state[endpoint];
+	while (packet) {
+		b = &table[index(endpoint + 1, TX, EVEN)];
+		switch (state) {
+		  case TX_STATE_BOTH_FREE_EVEN_FIRST:
+			state = TX_STATE_ODD_FREE;
+			break;
+		  case TX_STATE_BOTH_FREE_ODD_FIRST:
+			b++;
+			state = TX_STATE_EVEN_FREE;
+			break;
+		  case TX_STATE_EVEN_FREE:
+			state = TX_STATE_NONE_FREE_ODD_FIRST;
+			break;
+		  case TX_STATE_ODD_FREE:
+			b++;
+			state = TX_STATE_NONE_FREE_EVEN_FIRST;
+			break;
+		  default:
+			goto queue;
+		}
+		next = packet->next;
+		b->addr = packet->buf;
+		b->desc = BDT_DESC(packet->len, ((uint32_t)b & 8) ? DATA1 : DATA0);
+		TELEMETRY(telemetry_tx_depth(endpoint, 0));
+		packet = next;
+	}
+	queue:
+	tx_state[endpoint] = state;
+	if (packet) {
+		if (tx_first[endpoint] == NULL) {
+			tx_first[endpoint] = packet;
+		} else {
+			tx_last[endpoint]->next = packet;
+		}
+		while (1) {
+			TELEMETRY(telemetry_tx_depth(endpoint, ++tx_depth[endpoint]));
+			if (packet->next == NULL) break;
+			packet = packet->next;
+		}
+		tx_last[endpoint] = packet;
+	}
+	__enable_irq();
+}
+
+// Replace the contents of the newest packet that is still waiting in the
+// software queue, ie. not yet handed to the BDT.  Returns 1 if a packet was
+// overwritten, 0 if nothing is queued and the caller should use usb_tx().
+int usb_tx_overwrite_last(uint32_t endpoint, const void *data, uint32_t len)
+{
+	usb_packet_t *p;
+
+	endpoint--;
+	if (endpoint >= NUM_ENDPOINTS) return 0;
+	__disable_irq();
+	p = tx_first[endpoint] ? tx_last[endpoint] : NULL;
+	if (p) {
+		memcpy(p->buf, data, len);
+		p->len = len;
+	}
+	__enable_irq();
+	return p ? 1 : 0;
+}
+
 void usb_tx_isochronous(uint32_t endpoint, void *data, uint32_t len)
 {
 	bdt_t *b = &table[index(endpoint, TX, EVEN)];
@@ -923,6 +1068,24 @@ void usb_tx_isochronous(uint32_t endpoint, void *data, uint32_t len)
 
 
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+void usb_telemetry_snapshot(usb_telemetry_t *t)
+{
+	__disable_irq();
+	*t = telemetry;
+	__enable_irq();
+	usb_mem_telemetry(&t->mem);
+}
+
+void usb_telemetry_reset(void)
+{
+	__disable_irq();
+	memset(&telemetry, 0, sizeof(telemetry));
+	__enable_irq();
+	usb_mem_telemetry_reset();
+}
+#endif
+
 void _reboot_Teensyduino_(void)
 {
 	// TODO: initialize R0 with a code....
@@ -932,7 +1095,25 @@ void _reboot_Teensyduino_(void)
 
 
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+static void usb_isr_service(void);
+
 void usb_isr(void)
+{
+	uint32_t begin, ticks;
+
+	begin = TELEMETRY_NOW();
+	usb_isr_service();
+	ticks = TELEMETRY_NOW() - begin;
+	telemetry.isr_count++;
+	telemetry.isr_ticks_total += ticks;
+	if (ticks > telemetry.isr_ticks_max) telemetry.isr_ticks_max = ticks;
+}
+
+static void usb_isr_service(void)
+#else
+void usb_isr(void)
+#endif
 {
 	uint8_t status, stat, t;
 
@@ -944,6 +1125,10 @@ void usb_isr(void)
 	status = USB0_ISTAT;
 
 	if ((status & USB_ISTAT_SOFTOK /* 04 */ )) {
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+		telemetry.isr_sof++;
+		if (usb_rx_memory_needed) telemetry.rx_starved_frames++;
+#endif
 		if (usb_configuration) {
 			t = usb_reboot_timer;
 			if (t) {
@@ -986,6 +1171,12 @@ void usb_isr(void)
 #endif
 #ifdef MULTITOUCH_INTERFACE
 			usb_touchscreen_update_callback();
+#endif
+#if defined(DS4_INTERFACE) && defined(USB_DS4)
+			usb_ds4_sof_callback();
+#endif
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+			usb_hid_sof();
 #endif
 		}
 		USB0_ISTAT = USB_ISTAT_SOFTOK;
@@ -994,6 +1185,7 @@ void usb_isr(void)
 	if ((status & USB_ISTAT_TOKDNE /* 08 */ )) {
 		uint8_t endpoint;
 		stat = USB0_STAT;
+		TELEMETRY(telemetry.isr_token++);
 		//serial_print("token: ep=");
 		//serial_phex(stat >> 4);
 		//serial_print(stat & 0x08 ? ",tx" : ",rx");
@@ -1038,11 +1230,15 @@ void usb_isr(void)
 			} else
 #endif
 			if (stat & 0x08) { // transmit
+#if defined(DS4_INTERFACE) && defined(USB_DS4) && defined(DS4_TRACE) && DS4_TRACE == 1
+				if (endpoint == DS4_TX_ENDPOINT-1) usb_ds4_trace_tx_complete();
+#endif
 				usb_free(packet);
 				packet = tx_first[endpoint];
 				if (packet) {
 					//serial_print("tx packet\n");
 					tx_first[endpoint] = packet->next;
+					TELEMETRY(tx_depth[endpoint]--);
 					b->addr = packet->buf;
 					switch (tx_state[endpoint]) {
 					  case TX_STATE_BOTH_FREE_EVEN_FIRST:
@@ -1082,6 +1278,13 @@ void usb_isr(void)
 				}
 			} else { // receive
 				packet->len = b->desc >> 16;
+#if defined(DS4_INTERFACE) && defined(USB_DS4)
+				if (endpoint == DS4_RX_ENDPOINT-1 && packet->len > 0
+				  && usb_ds4_feedback_isr(packet->buf, packet->len)) {
+					// parsed in place, hand the same buffer back
+					packet->len = 0;
+				}
+#endif
 				if (packet->len > 0) {
 					packet->index = 0;
 					packet->next = NULL;
@@ -1116,6 +1319,7 @@ void usb_isr(void)
 						//serial_phex(endpoint + 1);
 						b->desc = 0;
 						usb_rx_memory_needed++;
+						TELEMETRY(telemetry.rx_starved++);
 					}
 				} else {
 					b->desc = BDT_DESC(64, ((uint32_t)b & 8) ? DATA1 : DATA0);
@@ -1131,11 +1335,17 @@ void usb_isr(void)
 
 	if (status & USB_ISTAT_USBRST /* 01 */ ) {
 		//serial_print("reset\n");
+		TELEMETRY(telemetry.isr_reset++);
 
 		// initialize BDT toggle bits
 		USB0_CTL = USB_CTL_ODDRST;
 		ep0_tx_bdt_bank = 0;
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+		// HID devices return to report protocol after reset
+		keyboard_protocol = 1;
+#endif
+
 		// set up buffers to receive Setup and OUT packets
 		table[index(0, RX, EVEN)].desc = BDT_DESC(EP0_SIZE, 0);
 		table[index(0, RX, EVEN)].addr = ep0_rx0_buf;
@@ -1171,11 +1381,13 @@ void usb_isr(void)
 
 	if ((status & USB_ISTAT_STALL /* 80 */ )) {
 		//serial_print("stall:\n");
+		TELEMETRY(telemetry.isr_stall++);
 		USB0_ENDPT0 = USB_ENDPT_EPRXEN | USB_ENDPT_EPTXEN | USB_ENDPT_EPHSHK;
 		USB0_ISTAT = USB_ISTAT_STALL;
 	}
 	if ((status & USB_ISTAT_ERROR /* 02 */ )) {
 		uint8_t err = USB0_ERRSTAT;
+		TELEMETRY(telemetry.isr_error++);
 		USB0_ERRSTAT = err;
 		//serial_print("err:");
 		//serial_phex(err);
@@ -1201,6 +1413,11 @@ void usb_init(void)
 
 	usb_init_serialnumber();
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1 && defined(KINETISK)
+	ARM_DEMCR |= ARM_DEMCR_TRCENA;
+	ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+
 	for (i=0; i < (NUM_ENDPOINTS+1)*4; i++) {
 		table[i].desc = 0;
 		table[i].addr = 0;
@@ -54,10 +54,47 @@ usb_packet_t *usb_rx(uint32_t endpoint);
 uint32_t usb_tx_byte_count(uint32_t endpoint);
 uint32_t usb_tx_packet_count(uint32_t endpoint);
 void usb_tx(uint32_t endpoint, usb_packet_t *packet);
+void usb_tx_chain(uint32_t endpoint, usb_packet_t *packet);
+int usb_tx_idle(uint32_t endpoint);
+int usb_tx_overwrite_last(uint32_t endpoint, const void *data, uint32_t len);
 void usb_tx_isochronous(uint32_t endpoint, void *data, uint32_t len);
 
 extern volatile uint8_t usb_configuration;
 
+// Telemetry (USB_TELEMETRY=1), for telling apart an exhausted buffer
+// pool, backed up transmit queues and starved receive endpoints
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+#ifndef USB_TELEMETRY_DEPTH_BUCKETS
+#define USB_TELEMETRY_DEPTH_BUCKETS 8
+#endif
+#if defined(KINETISK)
+#define USB_TELEMETRY_TICKS_PER_US (F_CPU / 1000000)
+#else
+#define USB_TELEMETRY_TICKS_PER_US 1
+#endif
+
+typedef struct {
+	usb_mem_telemetry_t mem;
+	// usb_tx calls by queue depth after the packet was added, 0 meaning
+	// it went straight to the hardware, the last bucket counts the rest
+	uint32_t tx_depth[NUM_ENDPOINTS][USB_TELEMETRY_DEPTH_BUCKETS];
+	uint8_t tx_depth_max[NUM_ENDPOINTS];
+	uint32_t rx_starved;		// receive buffers left without memory
+	uint32_t rx_starved_frames;	// SOFs seen with usb_rx_memory_needed set
+	uint32_t isr_count;
+	uint32_t isr_sof;
+	uint32_t isr_token;
+	uint32_t isr_reset;
+	uint32_t isr_stall;
+	uint32_t isr_error;
+	uint32_t isr_ticks_max;		// in USB_TELEMETRY_TICKS_PER_US units
+	uint64_t isr_ticks_total;
+} usb_telemetry_t;
+
+void usb_telemetry_snapshot(usb_telemetry_t *t);
+void usb_telemetry_reset(void);
+#endif
+
 extern uint16_t usb_rx_byte_count_data[NUM_ENDPOINTS];
 static inline uint32_t usb_rx_byte_count(uint32_t endpoint) __attribute__((always_inline));
 static inline uint32_t usb_rx_byte_count(uint32_t endpoint)
@@ -105,10 +142,19 @@ extern int usb_audio_set_feature(void *stp, uint8_t *buf);
 extern void usb_touchscreen_update_callback(void);
 #endif
 
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+extern void usb_hid_sof(void);
+#endif
+
 #if defined(DS4_INTERFACE) && defined(USB_DS4)
 extern uint8_t usb_ds4_reply_buffer[];
 extern int usb_ds4_on_set_report(void *setup_ptr, uint8_t *data);
-extern int usb_ds4_on_get_report(void *setup_ptr, uint8_t *data, uint32_t *len);
+extern int usb_ds4_on_get_report(void *setup_ptr, const uint8_t **data, uint32_t *len);
+extern void usb_ds4_sof_callback(void);
+extern int usb_ds4_feedback_isr(const uint8_t *data, uint32_t len);
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+extern void usb_ds4_trace_tx_complete(void);
+#endif
 #endif
 
 #if defined(DS4_INTERFACE) && defined(USB_DS4STUB)
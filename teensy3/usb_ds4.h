@@ -134,6 +134,31 @@ typedef struct {
     uint8_t padding[21]; // 11-31
 } __attribute__((packed)) ds4_feedback_t;
 
+typedef struct {
+    int16_t accel_x;
+    int16_t accel_y;
+    int16_t accel_z;
+    int16_t gyro_x;
+    int16_t gyro_y;
+    int16_t gyro_z;
+} ds4_imu_sample_t;
+
+// Sample ring filled by the sketch (or an ISR/DMA handler), drained on send.
+// size must be a power of 2, head is only written by the producer and tail
+// only by the DS4 driver.
+typedef struct {
+    ds4_imu_sample_t *samples;
+    uint16_t size;
+    volatile uint16_t head;
+    volatile uint16_t tail;
+} ds4_imu_ring_t;
+
+typedef struct {
+    int32_t state[6]; // filtered value << 8, in ds4_imu_sample_t order
+    uint8_t shift;
+    bool primed;
+} ds4_imu_filter_t;
+
 typedef struct {
     uint8_t type; // 0
     uint8_t host_bdaddr[6]; // 1-6
@@ -163,11 +188,112 @@ typedef struct {
     ds4_revision_t revision; // 1-48
 } __attribute__((packed)) ds4_getrevision_t;
 
+// Report recorder. Each record is a LEB128 microsecond delta to the previous
+// one, then a byte with the number of runs that differ from the previous
+// report (with its counter bumped), then per run: offset, length and the new
+// bytes. A run count of 0xff is a keyframe followed by the full report.
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t len; // bytes used
+    uint32_t count; // reports recorded
+    uint32_t dropped; // reports that didn't fit
+    uint32_t last_us;
+    ds4_report_t prev;
+} ds4_recorder_t;
+
+typedef struct {
+    const uint8_t *buf; // RAM or flash
+    uint32_t len;
+    uint32_t pos;
+    ds4_report_t report; // last decoded report
+} ds4_player_t;
+
 #define DS4_DPAD_SET(buttons, dir) \
     buttons[0] ^= buttons[0] & 0x0f; \
     buttons[0] |= dir & 0x0f;
 
-#define DS4_GET_SENSOR_TS() ((millis() * 150) & 0xffff)
+// Pages in each direction of an auth exchange
+#define DS4_AUTH_CHALLENGE_PAGES 5 // 0xf0
+#define DS4_AUTH_RESPONSE_PAGES 19 // 0xf1
+
+// Auth pages buffered in each direction, must be powers of 2. The challenge
+// ring holds one less than its size and has to fit a whole exchange, the
+// console aborts if a 0xf0 page is refused.
+#ifndef DS4_AUTH_QUEUE_SIZE
+#define DS4_AUTH_QUEUE_SIZE 4
+#endif
+#ifndef DS4_AUTH_CHALLENGE_QUEUE_SIZE
+#define DS4_AUTH_CHALLENGE_QUEUE_SIZE 8
+#endif
+
+// Serial auth bridge, see usb_ds4_class::beginAuthBridge()
+#ifndef DS4_AUTH_BRIDGE_BAUD
+#define DS4_AUTH_BRIDGE_BAUD 1000000
+#endif
+// ms without progress before response pages are requested again
+#ifndef DS4_AUTH_BRIDGE_TIMEOUT
+#define DS4_AUTH_BRIDGE_TIMEOUT 500
+#endif
+
+// Bridge frames: sync, type, payload length, payload, checksum. The bytes
+// from type through checksum sum to 0 (mod 256). Frames that don't check
+// out are dropped, the sender recovers by timeout.
+#define DS4_BRIDGE_SYNC 0xa5
+#define DS4_BRIDGE_RESET 0x01 // to responder, no payload: exchange aborted
+#define DS4_BRIDGE_CHALLENGE 0x02 // to responder, ds4_auth_t 0xf0 page
+#define DS4_BRIDGE_REQUEST 0x03 // to responder, seq and page: send this 0xf1 page when ready
+#define DS4_BRIDGE_RESPONSE 0x04 // from responder, ds4_auth_t 0xf1 page
+
+// Auth states, see usb_ds4_class::authState()
+#define DS4_AUTH_IDLE 0
+#define DS4_AUTH_CHALLENGE 1 // receiving 0xf0 pages
+#define DS4_AUTH_SIGNING 2 // console polls 0xf2, waiting for the first response page
+#define DS4_AUTH_RESPONDING 3 // console reads 0xf1 pages
+#define DS4_AUTH_DONE 4
+
+// Auth events, passed as the EventResponder status
+#define DS4_AUTH_EVENT_CHALLENGE 1 // data: the ds4_auth_t 0xf0 page just received
+#define DS4_AUTH_EVENT_RESPONSE_WANTED 2 // post the next 0xf1 page
+#define DS4_AUTH_EVENT_DONE 3 // last response page was read
+#define DS4_AUTH_EVENT_RESET 4 // console reset the exchange (0xf3)
+
+// Feedback fields, passed as the changed mask to feedback callbacks. Same
+// bits as ds4_feedback_t::flags, only fields flagged valid are published.
+#define DS4_FEEDBACK_RUMBLE 0x01
+#define DS4_FEEDBACK_LED 0x02
+#define DS4_FEEDBACK_FLASH 0x04
+
+// Minimum time between two touch frames within a report, in microseconds.
+// Defaults to spreading the three frames evenly over one polling interval.
+#ifndef DS4_TOUCH_FRAME_INTERVAL
+#define DS4_TOUCH_FRAME_INTERVAL (DS4_TX_INTERVAL * 1000 / 3)
+#endif
+
+// Max time between two identical reports when using coalesced send
+#ifndef DS4_KEEPALIVE_INTERVAL
+#define DS4_KEEPALIVE_INTERVAL 100
+#endif
+
+// How early before the next SOF the frame sync sampler runs, in microseconds
+#ifndef DS4_FRAME_SYNC_LEAD
+#define DS4_FRAME_SYNC_LEAD 100
+#endif
+
+// Sensor timestamp, in the console's 16/3 us units
+#define DS4_GET_SENSOR_TS() usb_ds4_sensor_timestamp()
+
+// Default IMU smoothing, as a shift: each new sample moves the filtered
+// value by 1/2^n of the difference. 0 passes the latest sample through.
+#ifndef DS4_IMU_SMOOTHING
+#define DS4_IMU_SMOOTHING 2
+#endif
+
+// With coalesced sending and an IMU attached, a report whose gyro or accel
+// moved by more than this many counts goes out even if nothing else did.
+#ifndef DS4_IMU_CHANGE_THRESHOLD
+#define DS4_IMU_CHANGE_THRESHOLD 0
+#endif
 
 #define DS4_BTN_SET(buttons, btn_id) \
     buttons[(btn_id >> 3) & 3] |= 1 << (btn_id & 7);
@@ -195,11 +321,50 @@ typedef struct {
 #define DS4_TOUCH_POS_PACK(touch, track_id, x, y) \
     ((y & 0xfff) << 20) | ((x & 0xfff) << 8) | (((~touch) & 1) << 7) | (track_id & 0x7f)
 
+// Latency tracing (DS4_TRACE=1)
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+#if defined(KINETISK)
+#define DS4_TRACE_NOW() ARM_DWT_CYCCNT
+#define DS4_TRACE_TICKS_PER_US (F_CPU / 1000000)
+#else
+// no DWT on Cortex-M0+
+#define DS4_TRACE_NOW() micros()
+#define DS4_TRACE_TICKS_PER_US 1
+#endif
+#ifndef DS4_TRACE_BUCKETS
+#define DS4_TRACE_BUCKETS 128
+#endif
+#ifndef DS4_TRACE_BUCKET_US
+#define DS4_TRACE_BUCKET_US 32
+#endif
+
+// Stages
+#define DS4_TRACE_INPUT_TO_TX 0 // first setter call -> usb_tx()
+#define DS4_TRACE_TX_TO_WIRE 1 // usb_tx() -> TX complete token
+#define DS4_TRACE_INPUT_TO_WIRE 2 // first setter call -> TX complete token
+#define DS4_TRACE_NUM_STAGES 3
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_ticks;
+    uint32_t max_ticks;
+    uint64_t sum_ticks;
+    uint16_t hist[DS4_TRACE_BUCKETS]; // DS4_TRACE_BUCKET_US wide, last one catches overflows
+} ds4_trace_stat_t;
+
+#define DS4_TRACE_INPUT() usb_ds4_trace_input()
+#else
+#define DS4_TRACE_INPUT()
+#endif
+
 // C language implementation
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Runs in the USB interrupt, changed is a DS4_FEEDBACK_* mask
+typedef void (*usb_ds4_feedback_callback_t)(const ds4_feedback_t *feedback, uint8_t changed);
+
 // buffers
 extern uint8_t usb_ds4_reply_buffer[];
 //extern ds4_report_t usb_ds4_report_buffer;
@@ -207,13 +372,64 @@ extern uint8_t usb_ds4_reply_buffer[];
 // C function prototypes
 extern int usb_ds4_send_report(const ds4_report_t *report, bool async);
 extern int usb_ds4_recv_feedback(ds4_feedback_t *feedback);
+extern void usb_ds4_feedback_enable(bool enable);
+extern void usb_ds4_feedback_attach(usb_ds4_feedback_callback_t callback);
+extern bool usb_ds4_feedback_snapshot(ds4_feedback_t *feedback, uint32_t *seq);
+extern int usb_ds4_feedback_isr(const uint8_t *data, uint32_t len);
+extern int usb_ds4_report_changed(const ds4_report_t *a, const ds4_report_t *b);
+extern int usb_ds4_motion_changed(const ds4_report_t *a, const ds4_report_t *b, uint16_t threshold);
+extern int usb_ds4_replace_report(const ds4_report_t *report);
 
 extern int usb_ds4_on_set_report(void *setup_ptr, uint8_t *data);
-extern int usb_ds4_on_get_report(void *setup_ptr, uint8_t *data, uint32_t *len);
+// Points *data at the reply, which is either a static table or
+// usb_ds4_reply_buffer
+extern int usb_ds4_on_get_report(void *setup_ptr, const uint8_t **data, uint32_t *len);
 
 extern void usb_ds4_auth_state_init(void);
+// CRC32 as used in auth pages and Bluetooth reports. Chains like zlib's
+// crc32(): start with 0 and pass the previous result to continue. Safe to
+// call from interrupts.
+extern uint32_t usb_ds4_crc32(uint32_t crc, const void *data, uint32_t len);
 
 extern void usb_ds4_report_init(ds4_report_t *report);
+extern uint16_t usb_ds4_sensor_timestamp(void);
+extern int usb_ds4_imu_process(ds4_imu_ring_t *ring, ds4_imu_filter_t *filter, ds4_report_t *report);
+
+// Producer side of ds4_imu_ring_t, false if the ring is full
+static inline bool usb_ds4_imu_push(ds4_imu_ring_t *ring, const ds4_imu_sample_t *sample) {
+    uint16_t head = ring->head;
+    uint16_t next = (head + 1) & (ring->size - 1);
+    if (next == ring->tail) return false;
+    ring->samples[head] = *sample;
+    __asm__ volatile("" ::: "memory");
+    ring->head = next;
+    return true;
+}
+
+extern void usb_ds4_sof_callback(void);
+// Frame sync state, see usb_ds4_class::beginFrameSync()
+#define DS4_FRAME_SYNC_OFF 0
+#define DS4_FRAME_SYNC_ON 1
+#define DS4_FRAME_SYNC_SAMPLING 2 // sampleInputs and the send are running
+extern volatile uint8_t usb_ds4_frame_sync;
+
+extern void usb_ds4_record_init(ds4_recorder_t *rec, void *buf, uint32_t size);
+extern int usb_ds4_record_report(ds4_recorder_t *rec, const ds4_report_t *report, uint32_t us);
+// Records every report handed to the endpoint, NULL stops
+extern void usb_ds4_record_attach(ds4_recorder_t *rec);
+extern void usb_ds4_replay_init(ds4_player_t *player, const void *buf, uint32_t len);
+extern int usb_ds4_replay_next(ds4_player_t *player, uint32_t *dt_us);
+extern int usb_ds4_replay(const void *buf, uint32_t len);
+
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+extern void usb_ds4_trace_input(void);
+extern void usb_ds4_trace_tx_complete(void);
+extern void usb_ds4_trace_reset(void);
+extern int usb_ds4_trace_get(uint8_t stage, ds4_trace_stat_t *stat);
+extern uint32_t usb_ds4_trace_mean_us(const ds4_trace_stat_t *stat);
+extern uint32_t usb_ds4_trace_percentile_us(const ds4_trace_stat_t *stat, uint8_t percent);
+extern void usb_ds4_trace_print(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -221,6 +437,10 @@ extern void usb_ds4_report_init(ds4_report_t *report);
 
 // C++ interface
 #ifdef __cplusplus
+#include "usb_button_map.h"
+
+class EventResponder;
+
 class usb_ds4_class {
 // C++ function prototypes
 
@@ -229,16 +449,41 @@ public:
     void begin(void) {
         usb_ds4_report_init(&reportBuffer);
         memset(&feedbackBuffer, 0, sizeof(ds4_feedback_t));
+        feedbackSeq = 0;
         pointCtr = 0;
+        touchBase = reportBuffer.frames[0];
+        touchPending = 0;
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+        usb_ds4_trace_reset();
+#endif
     }
 
     bool send(bool async) {
+        // while frame sync runs, reports only go out from its interrupt
+        if (usb_ds4_frame_sync == DS4_FRAME_SYNC_ON) return false;
         reportBuffer.sensor_timestamp = DS4_GET_SENSOR_TS();
-        if (usb_ds4_send_report(&reportBuffer, async) == 0) {
-            DS4_BTN_CTR_INC(reportBuffer.buttons);
+        if (imuRing) usb_ds4_imu_process(imuRing, &imuFilter, &reportBuffer);
+        publishTouchFrames();
+        if (coalesce) {
+            uint32_t now = millis();
+            if (lastQueuedValid && !usb_ds4_report_changed(&reportBuffer, &lastQueued)
+              && !(imuRing && usb_ds4_motion_changed(&reportBuffer, &lastQueued, DS4_IMU_CHANGE_THRESHOLD))) {
+                // nothing new for the console, only send the keepalive
+                if (now - lastQueuedMillis < keepalive) return true;
+            } else if (lastQueuedValid && replaceQueued()) {
+                touchFramesSent();
+                return true;
+            }
+            lastQueued = reportBuffer;
+            lastQueuedValid = sendQueued(async);
+            if (!lastQueuedValid) return false;
+            lastQueuedMillis = now;
+            touchFramesSent();
             return true;
         }
-        return false;
+        if (!sendQueued(async)) return false;
+        touchFramesSent();
+        return true;
     }
 
     bool send(void) {
@@ -249,91 +494,182 @@ public:
         return send(true);
     }
 
+    // Only send reports that differ from the last queued one (or once every
+    // keepaliveMillis), and fold new states into a report that is still
+    // waiting in the queue instead of queueing behind it.
+    void useCoalescedSend(bool mode, uint16_t keepaliveMillis = DS4_KEEPALIVE_INTERVAL) {
+        coalesce = mode;
+        keepalive = keepaliveMillis;
+        // make sure the first report after enabling goes out
+        lastQueuedValid = false;
+    }
+
+    // Frame synchronised sending. sampleInputs is called from a timer
+    // interrupt leadMicros before each USB start-of-frame, then the
+    // report is sent asynchronously from the same interrupt. While this is
+    // active the report belongs to that interrupt: the setters, touch and
+    // coalescing calls may only be used from sampleInputs, and send() from
+    // anywhere else returns false without sending. Meant for USB_DS4_TURBO
+    // (1 ms polling), combine with useCoalescedSend() to replace stale
+    // reports.
+    bool beginFrameSync(void (*sampleInputs)(void), uint16_t leadMicros = DS4_FRAME_SYNC_LEAD);
+    void endFrameSync(void);
+
     void update(void) {
+        // picks up interrupt delivered feedback, then anything still queued
+        usb_ds4_feedback_snapshot(&feedbackBuffer, &feedbackSeq);
         usb_ds4_recv_feedback(&feedbackBuffer);
     }
 
+    // Interrupt driven feedback. Once attached, OUT reports are parsed as
+    // they arrive and only changes to the fields the console flagged valid
+    // are published. The callback runs in the USB interrupt; the responder
+    // gets the DS4_FEEDBACK_* mask as status and the new feedback as data,
+    // copy it if it's needed later. update() and the getters keep working.
+    void attachFeedback(usb_ds4_feedback_callback_t callback) {
+        usb_ds4_feedback_attach(callback);
+        usb_ds4_feedback_enable(true);
+    }
+    void attachFeedbackEvent(EventResponder &event);
+    void detachFeedback(void);
+
+    // Motion data. Each send() drains the samples queued in ring and runs
+    // them through a fixed point exponential average (see
+    // DS4_IMU_SMOOTHING), so the filter work is done by whoever calls
+    // send(), a few cycles per queued sample. The result goes into every
+    // report sent.
+    void attachIMU(ds4_imu_ring_t *ring, uint8_t smoothing = DS4_IMU_SMOOTHING) {
+        memset(&imuFilter, 0, sizeof(ds4_imu_filter_t));
+        imuFilter.shift = (smoothing > 15) ? 15 : smoothing;
+        imuRing = ring;
+    }
+
+    void detachIMU(void) {
+        imuRing = NULL;
+    }
+
     void pressButton(uint8_t buttonId) {
+        DS4_TRACE_INPUT();
         DS4_BTN_SET(reportBuffer.buttons, buttonId);
     }
 
     void releaseButton(uint8_t buttonId) {
+        DS4_TRACE_INPUT();
         DS4_BTN_CLR(reportBuffer.buttons, buttonId);
     }
 
     void releaseAllButton(void) {
+        DS4_TRACE_INPUT();
         DS4_BTN_RESET(reportBuffer.buttons);
     }
 
     void pressDpad(uint8_t pos) {
+        DS4_TRACE_INPUT();
         DS4_DPAD_SET(reportBuffer.buttons, pos);
     }
 
     void releaseDpad(void) {
+        DS4_TRACE_INPUT();
         DS4_DPAD_SET(reportBuffer.buttons, DS4_DPAD_C);
     }
 
+    // Bulk update from a word of physical inputs, mapped at compile time
+    // with usb_button_map<> (positions are DS4_BTN_* ids or the
+    // USB_BUTTON_MAP_HAT_* directions). Only mapped buttons change and the
+    // report counter is left alone.
+    template <class Map>
+    void setButtons(uint32_t inputs) {
+        static_assert((Map::outputMask() & ~(uint32_t) 0x3fff0) == 0,
+            "DS4 button map may only use DS4_BTN_* positions");
+        DS4_TRACE_INPUT();
+        uint32_t word = reportBuffer.buttons[0] | (reportBuffer.buttons[1] << 8) |
+            ((uint32_t) reportBuffer.buttons[2] << 16);
+        word = (word & ~Map::outputMask()) | Map::buttons(inputs);
+        if (Map::hasHat()) word = (word & ~0x0f) | Map::hat(inputs);
+        reportBuffer.buttons[0] = word;
+        reportBuffer.buttons[1] = word >> 8;
+        reportBuffer.buttons[2] = word >> 16;
+    }
+
     void setLeftAnalog(uint8_t x, uint8_t y) {
+        DS4_TRACE_INPUT();
         reportBuffer.analog_l_x = x;
         reportBuffer.analog_l_y = y;
     }
 
     void setRightAnalog(uint8_t x, uint8_t y) {
+        DS4_TRACE_INPUT();
         reportBuffer.analog_r_x = x;
         reportBuffer.analog_r_y = y;
     }
 
     void setLeftTrigger(uint8_t val) {
+        DS4_TRACE_INPUT();
         reportBuffer.trigger_l = val;
     }
 
     void setRightTrigger(uint8_t val) {
+        DS4_TRACE_INPUT();
         reportBuffer.trigger_r = val;
     }
 
     void setTouchPos1(uint16_t x, uint16_t y) {
-        uint8_t pointTmp = DS4_TOUCH_GET_ID(reportBuffer.frames[0].pos1);
-        uint8_t touch = DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos1);
+        DS4_TRACE_INPUT();
+        ds4_touch_frame_t *frame = touchFrame();
+        uint8_t pointTmp = DS4_TOUCH_GET_ID(frame->pos1);
+        uint8_t touch = DS4_TOUCH_GET_STATE(frame->pos1);
         // If updating coordinates, do not bump the point id, otherwise bump it
         if (touch) {
-            reportBuffer.frames[0].pos1 = DS4_TOUCH_POS_PACK(1, pointTmp, x, y);
+            frame->pos1 = DS4_TOUCH_POS_PACK(1, pointTmp, x, y);
         } else {
-            reportBuffer.frames[0].pos1 = DS4_TOUCH_POS_PACK(1, pointCtr, x, y);
+            frame->pos1 = DS4_TOUCH_POS_PACK(1, pointCtr, x, y);
         }
-        reportBuffer.frames[0].seq++;
     }
 
     void setTouchPos2(uint16_t x, uint16_t y) {
-        uint8_t pointTmp = DS4_TOUCH_GET_ID(reportBuffer.frames[0].pos2);
-        uint8_t touch = DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos2);
+        DS4_TRACE_INPUT();
+        ds4_touch_frame_t *frame = touchFrame();
+        uint8_t pointTmp = DS4_TOUCH_GET_ID(frame->pos2);
+        uint8_t touch = DS4_TOUCH_GET_STATE(frame->pos2);
         // If updating coordinates, do not bump the point id, otherwise bump it
         if (touch) {
-            reportBuffer.frames[0].pos2 = DS4_TOUCH_POS_PACK(1, pointTmp, x, y);
+            frame->pos2 = DS4_TOUCH_POS_PACK(1, pointTmp, x, y);
         } else {
-            reportBuffer.frames[0].pos2 = DS4_TOUCH_POS_PACK(1, pointCtr, x, y);
+            frame->pos2 = DS4_TOUCH_POS_PACK(1, pointCtr, x, y);
         }
-        reportBuffer.frames[0].seq++;
     }
 
     void releaseTouchPos1(void) {
-        pointCtr += DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos1);
-        DS4_TOUCH_RELEASE(reportBuffer.frames[0].pos1);
-        reportBuffer.frames[0].seq++;
+        DS4_TRACE_INPUT();
+        ds4_touch_frame_t *frame = touchFrame();
+        pointCtr += DS4_TOUCH_GET_STATE(frame->pos1);
+        DS4_TOUCH_RELEASE(frame->pos1);
     }
 
     void releaseTouchPos2(void) {
-        pointCtr += DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos2);
-        DS4_TOUCH_RELEASE(reportBuffer.frames[0].pos2);
-        reportBuffer.frames[0].seq++;
+        DS4_TRACE_INPUT();
+        ds4_touch_frame_t *frame = touchFrame();
+        pointCtr += DS4_TOUCH_GET_STATE(frame->pos2);
+        DS4_TOUCH_RELEASE(frame->pos2);
     }
 
     void releaseTouchAll(void) {
-        pointCtr += DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos1);
-        DS4_TOUCH_RELEASE(reportBuffer.frames[0].pos1);
-        pointCtr += DS4_TOUCH_GET_STATE(reportBuffer.frames[0].pos2);
-        DS4_TOUCH_RELEASE(reportBuffer.frames[0].pos2);
+        DS4_TRACE_INPUT();
+        ds4_touch_frame_t *frame = touchFrame();
+        pointCtr += DS4_TOUCH_GET_STATE(frame->pos1);
+        DS4_TOUCH_RELEASE(frame->pos1);
+        pointCtr += DS4_TOUCH_GET_STATE(frame->pos2);
+        DS4_TOUCH_RELEASE(frame->pos2);
         pointCtr++;
-        reportBuffer.frames[0].seq++;
+    }
+
+    // Up to two contacts at height y, as from TouchSlider::read(). Contacts
+    // that are gone are released.
+    void setTouchContacts(uint8_t count, const uint16_t *x, uint16_t y) {
+        if (count > 0) setTouchPos1(x[0], y);
+        else releaseTouchPos1();
+        if (count > 1) setTouchPos2(x[1], y);
+        else releaseTouchPos2();
     }
 
     bool hasValidFeedback(void) {
@@ -362,7 +698,26 @@ public:
         return feedbackBuffer.led_flash_off;
     }
 
-    // Run these in critical section to prevent race conditions
+    // Bluetooth address reported in feature report 0x12 (little endian)
+    void setDeviceAddress(const uint8_t *bdaddr);
+    // Host address and link key set by the console with feature report
+    // 0x13, false if it hasn't paired yet
+    bool getPairing(ds4_pair_t *pair);
+
+    // Event driven authentication. The responder is triggered from the USB
+    // interrupt with a DS4_AUTH_EVENT_* status; attach it with attach() to
+    // be called from yield() or attachImmediate() to run in the ISR itself.
+    // Challenge pages are read with authReadChallenge() and responses are
+    // posted with authPostResponse(), neither needs interrupts disabled.
+    void attachAuthEvent(EventResponder &event);
+    void detachAuthEvent(void);
+    uint8_t authState(void);
+    // pops the oldest pending 0xf0 page, false if there's none
+    bool authReadChallenge(ds4_auth_t *page);
+    // queues a 0xf1 page, false if the queue is full
+    bool authPostResponse(const ds4_auth_t *page);
+
+    // Polled interface, implemented on top of the above.
     // true if there's new challenge, false otherwise
     bool authChallengeAvailable(void);
     // returns the main buffer, clears new flag
@@ -378,10 +733,83 @@ public:
     // true if PS4 asked and we can send the response, false otherwise
     bool authResponseAvailable(void);
 
+    // Hands authentication to a responder on a serial port (see
+    // DS4_BRIDGE_*). Runs from yield() and takes the auth event slot.
+    void beginAuthBridge(HardwareSerial &port, uint32_t baud = DS4_AUTH_BRIDGE_BAUD);
+    void endAuthBridge(void);
+
 private:
+    bool sendQueued(bool async) {
+        if (usb_ds4_send_report(&reportBuffer, async) == 0) {
+            DS4_BTN_CTR_INC(reportBuffer.buttons);
+            return true;
+        }
+        return false;
+    }
+
+    // Overwrite the report still waiting in the endpoint queue, if any. The
+    // queued report keeps its counter so the console sees no gap.
+    bool replaceQueued(void) {
+        uint8_t ctr = reportBuffer.buttons[2];
+        bool replaced;
+        reportBuffer.buttons[2] = (ctr & 0x03) | (lastQueued.buttons[2] & 0xfc);
+        replaced = usb_ds4_replace_report(&reportBuffer);
+        if (replaced) lastQueued = reportBuffer;
+        reportBuffer.buttons[2] = ctr;
+        return replaced;
+    }
+
+    // Touch history. Setters edit the newest pending snapshot, a new one is
+    // opened once the newest is DS4_TOUCH_FRAME_INTERVAL old, and up to three
+    // of them go out with each report, oldest first.
+    ds4_touch_frame_t *touchFrame(void) {
+        uint32_t now = micros();
+        if (touchPending == 0 || now - touchFrameMicros >= DS4_TOUCH_FRAME_INTERVAL) {
+            const ds4_touch_frame_t *prev = touchPending ? &touchQueue[touchPending - 1] : &touchBase;
+            if (touchPending == 3) {
+                touchQueue[0] = touchQueue[1];
+                touchQueue[1] = touchQueue[2];
+                touchPending = 2;
+            }
+            touchQueue[touchPending] = *prev;
+            touchQueue[touchPending].seq++;
+            touchPending++;
+            touchFrameMicros = now;
+        }
+        return &touchQueue[touchPending - 1];
+    }
+
+    void publishTouchFrames(void) {
+        const ds4_touch_frame_t *frames = touchPending ? touchQueue : &touchBase;
+        uint8_t count = touchPending ? touchPending : 1;
+        for (uint8_t i=0; i<3; i++) {
+            // unused slots repeat the newest frame
+            reportBuffer.frames[i] = frames[(i < count) ? i : count - 1];
+        }
+        reportBuffer.tp_available_frame = count;
+    }
+
+    void touchFramesSent(void) {
+        if (touchPending) touchBase = touchQueue[touchPending - 1];
+        touchPending = 0;
+    }
+
     ds4_report_t reportBuffer;
     ds4_feedback_t feedbackBuffer;
+    uint32_t feedbackSeq;
     uint8_t pointCtr;
+    ds4_imu_ring_t *imuRing;
+    ds4_imu_filter_t imuFilter;
+    ds4_touch_frame_t touchBase; // last published state
+    ds4_touch_frame_t touchQueue[3];
+    uint8_t touchPending;
+    uint32_t touchFrameMicros;
+    // Coalesced send state
+    bool coalesce;
+    bool lastQueuedValid;
+    uint16_t keepalive;
+    uint32_t lastQueuedMillis;
+    ds4_report_t lastQueued;
 };
 
 extern usb_ds4_class DS4;
@@ -0,0 +1,147 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "usb_dev.h"
+#include "usb_hid_sched.h"
+#include "core_pins.h" // for yield()
+
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+#if F_CPU >= 20000000 && defined(NUM_ENDPOINTS)
+
+// slots that have posted at least once
+static usb_hid_slot_t *slot_list = NULL;
+
+// Maximum number of transmit packets to queue so we don't starve other endpoints for memory
+#define TX_PACKET_LIMIT 3
+
+// When the PC isn't listening, how long do we wait before discarding data?
+#define TX_TIMEOUT_MSEC 30
+#if F_CPU == 256000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1706)
+#elif F_CPU == 240000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1600)
+#elif F_CPU == 216000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1440)
+#elif F_CPU == 192000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1280)
+#elif F_CPU == 180000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1200)
+#elif F_CPU == 168000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 1100)
+#elif F_CPU == 144000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 932)
+#elif F_CPU == 120000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 764)
+#elif F_CPU == 96000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 596)
+#elif F_CPU == 72000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 512)
+#elif F_CPU == 48000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 428)
+#elif F_CPU == 24000000
+  #define TX_TIMEOUT (TX_TIMEOUT_MSEC * 262)
+#endif
+
+// Mark the slot's state as changed, it will be sent at the next idle SOF
+void usb_hid_post(usb_hid_slot_t *slot)
+{
+	__disable_irq();
+	if (!slot->registered) {
+		slot->next = slot_list;
+		slot_list = slot;
+		slot->registered = 1;
+	}
+	slot->pending = 1;
+	__enable_irq();
+}
+
+// Queue the pending report right away, for when the next state would hide
+// a change the host has not seen yet.  Returns 0 on success, -1 if the
+// host is not listening.
+int usb_hid_flush(usb_hid_slot_t *slot)
+{
+	uint32_t wait_count=0, len=0;
+	usb_packet_t *tx_packet;
+
+	while (1) {
+		if (!usb_configuration) {
+			return -1;
+		}
+		if (!slot->pending) {
+			return 0; // already sent at SOF
+		}
+		if (usb_tx_packet_count(slot->endpoint) < TX_PACKET_LIMIT) {
+			tx_packet = usb_malloc();
+			if (tx_packet) break;
+		}
+		if (++wait_count > TX_TIMEOUT) {
+			return -1;
+		}
+		yield();
+	}
+	__disable_irq();
+	if (slot->pending) {
+		slot->pending = 0;
+		len = slot->build(slot, tx_packet->buf);
+	}
+	__enable_irq();
+	if (len) {
+		tx_packet->len = len;
+		usb_tx(slot->endpoint, tx_packet);
+	} else {
+		usb_free(tx_packet);
+	}
+	return 0;
+}
+
+// Called from usb_isr at every SOF
+void usb_hid_sof(void)
+{
+	usb_hid_slot_t *slot;
+	usb_packet_t *tx_packet;
+	uint32_t len;
+
+	for (slot = slot_list; slot; slot = slot->next) {
+		if (!slot->pending || !usb_tx_idle(slot->endpoint)) continue;
+		tx_packet = usb_malloc();
+		if (!tx_packet) return;
+		slot->pending = 0;
+		len = slot->build(slot, tx_packet->buf);
+		if (len) {
+			tx_packet->len = len;
+			usb_tx(slot->endpoint, tx_packet);
+		} else {
+			usb_free(tx_packet);
+		}
+	}
+}
+
+#endif // F_CPU
+#endif // USB_HID_SCHEDULER
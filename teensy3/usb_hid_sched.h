@@ -0,0 +1,68 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2019 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef USBhidsched_h_
+#define USBhidsched_h_
+
+#include "usb_desc.h"
+
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+
+#include <inttypes.h>
+
+// Start of frame report scheduling (USB_HID_SCHEDULER=1).  Instead of
+// queueing a packet on every call, a HID interface keeps its latest state
+// and posts its slot.  At the next SOF where the endpoint is idle, the
+// slot's build function writes one report from the state at that moment,
+// so the host always reads the newest state.
+typedef struct usb_hid_slot_struct {
+	// Called in the USB interrupt, or by usb_hid_flush with interrupts
+	// disabled.  Returns the report length, or 0 to send nothing.  Setting
+	// pending again asks for another report in the next frame.
+	uint32_t (*build)(struct usb_hid_slot_struct *slot, uint8_t *buf);
+	struct usb_hid_slot_struct *next;
+	uint8_t endpoint;
+	volatile uint8_t pending;
+	uint8_t registered;
+} usb_hid_slot_t;
+
+// C language implementation
+#ifdef __cplusplus
+extern "C" {
+#endif
+void usb_hid_post(usb_hid_slot_t *slot);
+int usb_hid_flush(usb_hid_slot_t *slot);
+void usb_hid_sof(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_HID_SCHEDULER
+#endif // USBhidsched_h_
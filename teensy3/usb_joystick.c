@@ -30,6 +30,7 @@
 
 #include "usb_dev.h"
 #include "usb_joystick.h"
+#include "usb_hid_sched.h"
 #include "core_pins.h" // for yield()
 #include "HardwareSerial.h"
 #include <string.h> // for memcpy()
@@ -76,6 +77,50 @@ static uint8_t transmit_previous_timeout=0;
 
 
 
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+#if JOYSTICK_SIZE == 64
+#define JOYSTICK_BUTTON_WORDS 4
+#else
+#define JOYSTICK_BUTTON_WORDS 1
+#endif
+
+static uint32_t joystick_report[(JOYSTICK_SIZE+3)/4];	// latest state
+static uint32_t joystick_buttons_sent[JOYSTICK_BUTTON_WORDS];
+
+static uint32_t joystick_build(usb_hid_slot_t *slot, uint8_t *buf)
+{
+	memcpy(buf, joystick_report, JOYSTICK_SIZE);
+	memcpy(joystick_buttons_sent, joystick_report, sizeof(joystick_buttons_sent));
+	return JOYSTICK_SIZE;
+}
+
+static usb_hid_slot_t joystick_slot = {
+	.build = joystick_build,
+	.endpoint = JOYSTICK_ENDPOINT
+};
+
+// Axes are absolute, so only the newest values matter.  A button that
+// changes twice before the host read it forces the pending report out.
+int usb_joystick_send(void)
+{
+	uint32_t i, changed = 0;
+
+	if (!usb_configuration) return -1;
+	if (joystick_slot.pending) {
+		for (i=0; i < JOYSTICK_BUTTON_WORDS; i++) {
+			changed |= (joystick_buttons_sent[i] ^ joystick_report[i])
+				& (joystick_report[i] ^ usb_joystick_data[i]);
+		}
+		if (changed && usb_hid_flush(&joystick_slot)) return -1;
+	}
+	__disable_irq();
+	memcpy(joystick_report, usb_joystick_data, JOYSTICK_SIZE);
+	__enable_irq();
+	usb_hid_post(&joystick_slot);
+	return 0;
+}
+
+#else
 int usb_joystick_send(void)
 {
         uint32_t wait_count=0;
@@ -106,6 +151,7 @@ int usb_joystick_send(void)
 	//serial_print("ok\n");
         return 0;
 }
+#endif // USB_HID_SCHEDULER
 
 
 
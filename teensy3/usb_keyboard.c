@@ -30,6 +30,7 @@
 
 #include "usb_dev.h"
 #include "usb_keyboard.h"
+#include "usb_hid_sched.h"
 #include "core_pins.h" // for yield()
 #include "keylayouts.h"
 //#include "HardwareSerial.h"
@@ -54,8 +55,21 @@ uint8_t keymedia_system_keys[3];
 // protocol setting from the host.  We use exactly the same report
 // either way, so this variable only stores the setting since we
 // are required to be able to report which setting is in use.
+// With the NKRO interface, boot protocol selects the 6KRO keyboard.
 uint8_t keyboard_protocol=1;
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+// which keys are currently pressed in NKRO mode, one bit per key usage.
+// Used instead of keyboard_keys while the host is in report protocol.
+uint8_t keyboard_nkro_keys[KEYBOARD_NKRO_KEYS / 8];
+static uint8_t keyboard_nkro_enable=1;
+
+static inline int keyboard_nkro_active(void)
+{
+	return keyboard_nkro_enable && keyboard_protocol;
+}
+#endif
+
 // the idle configuration, how often we send the report to the
 // host (ms * 4) even when it hasn't changed
 uint8_t keyboard_idle_config=125;
@@ -407,6 +421,16 @@ static void usb_keyboard_press_key(uint8_t key, uint8_t modifier)
 			send_required = 1;
 		}
 	}
+#ifdef KEYBOARD_NKRO_INTERFACE
+	if (key && keyboard_nkro_active()) {
+		if (key < KEYBOARD_NKRO_KEYS
+		  && !(keyboard_nkro_keys[key >> 3] & (1 << (key & 7)))) {
+			keyboard_nkro_keys[key >> 3] |= (1 << (key & 7));
+			send_required = 1;
+		}
+		goto end;
+	}
+#endif
 	if (key) {
 		for (i=0; i < 6; i++) {
 			if (keyboard_keys[i] == key) goto end;
@@ -434,6 +458,15 @@ static void usb_keyboard_release_key(uint8_t key, uint8_t modifier)
 			send_required = 1;
 		}
 	}
+#ifdef KEYBOARD_NKRO_INTERFACE
+	// release from both, the key may have been pressed before the
+	// host changed protocol
+	if (key && key < KEYBOARD_NKRO_KEYS
+	  && (keyboard_nkro_keys[key >> 3] & (1 << (key & 7)))) {
+		keyboard_nkro_keys[key >> 3] &= ~(1 << (key & 7));
+		send_required = 1;
+	}
+#endif
 	if (key) {
 		for (i=0; i < 6; i++) {
 			if (keyboard_keys[i] == key) {
@@ -455,6 +488,12 @@ void usb_keyboard_release_all(void)
 		anybits |= keyboard_keys[i];
 		keyboard_keys[i] = 0;
 	}
+#ifdef KEYBOARD_NKRO_INTERFACE
+	for (i=0; i < sizeof(keyboard_nkro_keys); i++) {
+		anybits |= keyboard_nkro_keys[i];
+		keyboard_nkro_keys[i] = 0;
+	}
+#endif
 	if (anybits) usb_keyboard_send();
 #ifdef KEYMEDIA_INTERFACE
 	anybits = 0;
@@ -523,6 +562,181 @@ static uint8_t transmit_previous_timeout=0;
 #endif
 
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+#define KEYBOARD_NKRO_REPORT_SIZE (1 + sizeof(keyboard_nkro_keys))
+
+// the modifiers and the NKRO bitmap, plus any keys put directly in
+// keyboard_keys by Keyboard.set_key1() etc
+static void keyboard_nkro_report_fill(uint8_t *buf)
+{
+	uint8_t key;
+	int i;
+
+	buf[0] = keyboard_modifier_keys;
+	memcpy(buf + 1, keyboard_nkro_keys, sizeof(keyboard_nkro_keys));
+	for (i=0; i < 6; i++) {
+		key = keyboard_keys[i];
+		if (key && key < KEYBOARD_NKRO_KEYS) {
+			buf[1 + (key >> 3)] |= (1 << (key & 7));
+		}
+	}
+}
+
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+static uint8_t keyboard_nkro_report[KEYBOARD_NKRO_REPORT_SIZE];
+static uint8_t keyboard_nkro_report_sent[KEYBOARD_NKRO_REPORT_SIZE];
+
+static uint32_t keyboard_nkro_build(usb_hid_slot_t *slot, uint8_t *buf)
+{
+	memcpy(buf, keyboard_nkro_report, KEYBOARD_NKRO_REPORT_SIZE);
+	memcpy(keyboard_nkro_report_sent, keyboard_nkro_report, KEYBOARD_NKRO_REPORT_SIZE);
+	return KEYBOARD_NKRO_REPORT_SIZE;
+}
+
+static usb_hid_slot_t keyboard_nkro_slot = {
+	.build = keyboard_nkro_build,
+	.endpoint = KEYBOARD_NKRO_ENDPOINT
+};
+
+// Every key and modifier is one bit, so replacing pending would hide a
+// press or release wherever a bit changes both from sent to pending and
+// from pending to next.
+static int keyboard_nkro_must_flush(const uint8_t *sent, const uint8_t *pending,
+	const uint8_t *next)
+{
+	uint32_t i;
+
+	for (i=0; i < KEYBOARD_NKRO_REPORT_SIZE; i++) {
+		if ((sent[i] ^ pending[i]) & (pending[i] ^ next[i])) return 1;
+	}
+	return 0;
+}
+
+static int usb_keyboard_nkro_send(void)
+{
+	uint8_t report[KEYBOARD_NKRO_REPORT_SIZE];
+
+	if (!usb_configuration) return -1;
+	keyboard_nkro_report_fill(report);
+	if (keyboard_nkro_slot.pending && keyboard_nkro_must_flush(
+	  keyboard_nkro_report_sent, keyboard_nkro_report, report)) {
+		if (usb_hid_flush(&keyboard_nkro_slot)) return -1;
+	}
+	__disable_irq();
+	memcpy(keyboard_nkro_report, report, KEYBOARD_NKRO_REPORT_SIZE);
+	__enable_irq();
+	usb_hid_post(&keyboard_nkro_slot);
+	return 0;
+}
+
+#else
+static int usb_keyboard_nkro_send(void)
+{
+	uint32_t wait_count=0;
+	usb_packet_t *tx_packet;
+
+	while (1) {
+		if (!usb_configuration) {
+			return -1;
+		}
+		if (usb_tx_packet_count(KEYBOARD_NKRO_ENDPOINT) < TX_PACKET_LIMIT) {
+			tx_packet = usb_malloc();
+			if (tx_packet) break;
+		}
+		if (++wait_count > TX_TIMEOUT || transmit_previous_timeout) {
+			transmit_previous_timeout = 1;
+			return -1;
+		}
+		yield();
+	}
+	transmit_previous_timeout = 0;
+	keyboard_nkro_report_fill(tx_packet->buf);
+	tx_packet->len = KEYBOARD_NKRO_REPORT_SIZE;
+	usb_tx(KEYBOARD_NKRO_ENDPOINT, tx_packet);
+	return 0;
+}
+#endif
+
+// Turn NKRO reports on or off.  Keys held in either mode are released.
+void usb_keyboard_nkro(uint8_t enable)
+{
+	usb_keyboard_release_all();
+	keyboard_nkro_enable = enable ? 1 : 0;
+}
+#endif
+
+
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+static uint8_t keyboard_report[8];	// latest state, waiting for SOF
+static uint8_t keyboard_report_sent[8];	// last one built
+
+static uint32_t keyboard_build(usb_hid_slot_t *slot, uint8_t *buf)
+{
+	memcpy(buf, keyboard_report, 8);
+	memcpy(keyboard_report_sent, keyboard_report, 8);
+	return 8;
+}
+
+static usb_hid_slot_t keyboard_slot = {
+	.build = keyboard_build,
+	.endpoint = KEYBOARD_ENDPOINT
+};
+
+static int keyboard_report_has(const uint8_t *report, uint8_t key)
+{
+	int i;
+
+	for (i=2; i < 8; i++) {
+		if (report[i] == key) return 1;
+	}
+	return 0;
+}
+
+// Returns 1 if a key or modifier changes both from sent to pending and
+// from pending to next, so replacing pending would hide a press or
+// release from the host.
+static int keyboard_must_flush(const uint8_t *sent, const uint8_t *pending,
+	const uint8_t *next)
+{
+	uint8_t key;
+	int i;
+
+	if ((sent[0] ^ pending[0]) & (pending[0] ^ next[0])) return 1;
+	for (i=2; i < 8; i++) {
+		key = pending[i];
+		if (key && !keyboard_report_has(sent, key)
+		  && !keyboard_report_has(next, key)) return 1;
+		key = sent[i];
+		if (key && !keyboard_report_has(pending, key)
+		  && keyboard_report_has(next, key)) return 1;
+	}
+	return 0;
+}
+
+// send the contents of keyboard_keys and keyboard_modifier_keys
+int usb_keyboard_send(void)
+{
+	uint8_t report[8];
+
+#ifdef KEYBOARD_NKRO_INTERFACE
+	if (keyboard_nkro_active()) return usb_keyboard_nkro_send();
+#endif
+	if (!usb_configuration) return -1;
+	report[0] = keyboard_modifier_keys;
+	report[1] = 0;
+	memcpy(report + 2, keyboard_keys, 6);
+	if (keyboard_slot.pending
+	  && keyboard_must_flush(keyboard_report_sent, keyboard_report, report)) {
+		if (usb_hid_flush(&keyboard_slot)) return -1;
+	}
+	__disable_irq();
+	memcpy(keyboard_report, report, 8);
+	__enable_irq();
+	usb_hid_post(&keyboard_slot);
+	return 0;
+}
+
+#else
 // send the contents of keyboard_keys and keyboard_modifier_keys
 int usb_keyboard_send(void)
 {
@@ -541,6 +755,9 @@ int usb_keyboard_send(void)
 	uint32_t wait_count=0;
 	usb_packet_t *tx_packet;
 
+#ifdef KEYBOARD_NKRO_INTERFACE
+	if (keyboard_nkro_active()) return usb_keyboard_nkro_send();
+#endif
 	while (1) {
 		if (!usb_configuration) {
 			return -1;
@@ -563,6 +780,7 @@ int usb_keyboard_send(void)
 #endif
 	return 0;
 }
+#endif // USB_HID_SCHEDULER
 
 
 
@@ -53,6 +53,11 @@ int usb_keyboard_send(void);
 #ifdef KEYMEDIA_INTERFACE
 void usb_keymedia_release_all(void);
 #endif
+#ifdef KEYBOARD_NKRO_INTERFACE
+#define KEYBOARD_NKRO_KEYS 224
+void usb_keyboard_nkro(uint8_t enable);
+extern uint8_t keyboard_nkro_keys[KEYBOARD_NKRO_KEYS / 8];
+#endif
 extern uint8_t keyboard_modifier_keys;
 extern uint8_t keyboard_keys[6];
 extern uint8_t keyboard_protocol;
@@ -87,6 +92,16 @@ public:
 	void set_key4(uint8_t c) { keyboard_keys[3] = c; }
 	void set_key5(uint8_t c) { keyboard_keys[4] = c; }
 	void set_key6(uint8_t c) { keyboard_keys[5] = c; }
+#ifdef KEYBOARD_NKRO_INTERFACE
+	// Set or clear one key in the NKRO bitmap without sending, so many
+	// keys can change in a single report with send_now()
+	void set_nkro_key(uint8_t key, bool pressed) {
+		if (key >= KEYBOARD_NKRO_KEYS) return;
+		if (pressed) keyboard_nkro_keys[key >> 3] |= (1 << (key & 7));
+		else keyboard_nkro_keys[key >> 3] &= ~(1 << (key & 7));
+	}
+	void nkro(bool enable) { usb_keyboard_nkro(enable ? 1 : 0); }
+#endif
 #ifdef KEYMEDIA_INTERFACE
 	void set_media(uint16_t c) {
 		if (c == 0) {
@@ -38,31 +38,294 @@
 __attribute__ ((section(".usbbuffers"), used))
 unsigned char usb_buffer_memory[NUM_USB_BUFFERS * sizeof(usb_packet_t)];
 
-static uint32_t usb_buffer_available = 0xFFFFFFFF;
+// Free buffers are tracked with one bit per buffer, 32 per word, and a
+// summary word with a bit for each word that has any free buffer.  That
+// keeps allocation at two CLZ instructions for up to 1024 buffers.
+#define USB_MEM_WORDS ((NUM_USB_BUFFERS + 31) / 32)
+#if USB_MEM_WORDS > 32
+#error "NUM_USB_BUFFERS must be 1024 or less"
+#endif
+#if (NUM_USB_BUFFERS & 31) != 0
+#define USB_MEM_LAST_WORD (~(0xFFFFFFFF >> (NUM_USB_BUFFERS & 31)))
+#else
+#define USB_MEM_LAST_WORD 0xFFFFFFFF
+#endif
 
-// use bitmask and CLZ instruction to implement fast free list
-// http://www.archivum.info/gnu.gcc.help/2006-08/00148/Re-GCC-Inline-Assembly.html
-// http://gcc.gnu.org/ml/gcc/2012-06/msg00015.html
-// __builtin_clz()
+#if USB_MEM_WORDS > 1
+static volatile uint32_t usb_buffer_available[USB_MEM_WORDS] = {
+	[0 ... USB_MEM_WORDS - 2] = 0xFFFFFFFF, [USB_MEM_WORDS - 1] = USB_MEM_LAST_WORD
+};
+#else
+static volatile uint32_t usb_buffer_available[1] = { USB_MEM_LAST_WORD };
+#endif
+static volatile uint32_t usb_buffer_summary = ~(0xFFFFFFFF >> (USB_MEM_WORDS - 1) >> 1);
 
-usb_packet_t * usb_malloc(void)
+// Reservations: an endpoint can have buffers set aside that only
+// usb_malloc_ep() for that endpoint may take, so busy endpoints can't
+// starve it.  Each allocation first takes a unit from its endpoint's
+// credit or else from the shared count, so a bit is always there to claim.
+#if defined(DS4_TX_ENDPOINT) && defined(DS4_TX_RESERVE)
+#define USB_MEM_RESERVED DS4_TX_RESERVE
+#else
+#define USB_MEM_RESERVED 0
+#endif
+static uint8_t usb_buffer_owner[NUM_USB_BUFFERS]; // endpoint, 0x80 = reserved unit
+static uint8_t usb_buffer_reserve[NUM_ENDPOINTS + 1] = {
+#if USB_MEM_RESERVED > 0
+	[DS4_TX_ENDPOINT] = DS4_TX_RESERVE,
+#endif
+};
+static volatile uint32_t usb_buffer_credit[NUM_ENDPOINTS + 1] = {
+#if USB_MEM_RESERVED > 0
+	[DS4_TX_ENDPOINT] = DS4_TX_RESERVE,
+#endif
+};
+static volatile uint32_t usb_buffer_shared = NUM_USB_BUFFERS - USB_MEM_RESERVED;
+
+#if defined(KINETISK)
+// Cortex-M4: every update is an exclusive load/store loop, so interrupts
+// are never masked.  An interrupt between LDREX and STREX makes the
+// STREX fail and the loop retries.
+
+static inline uint32_t mem_ldrex(volatile uint32_t *p)
 {
-	unsigned int n, avail;
-	uint8_t *p;
+	uint32_t v;
+	__asm__ volatile("ldrex %0, [%1]" : "=r" (v) : "r" (p) : "memory");
+	return v;
+}
+
+// returns 0 if the store succeeded
+static inline uint32_t mem_strex(uint32_t v, volatile uint32_t *p)
+{
+	uint32_t fail;
+	__asm__ volatile("strex %0, %2, [%1]" : "=&r" (fail) : "r" (p), "r" (v) : "memory");
+	return fail;
+}
+
+static inline void mem_clrex(void)
+{
+	__asm__ volatile("clrex" ::: "memory");
+}
+
+static inline uint32_t mem_fetch_or(volatile uint32_t *p, uint32_t mask)
+{
+	uint32_t old;
+	do {
+		old = mem_ldrex(p);
+	} while (mem_strex(old | mask, p));
+	return old;
+}
+
+static inline uint32_t mem_fetch_and(volatile uint32_t *p, uint32_t mask)
+{
+	uint32_t old;
+	do {
+		old = mem_ldrex(p);
+	} while (mem_strex(old & mask, p));
+	return old;
+}
+
+// subtracts up to n, returns how much was taken
+static inline uint32_t mem_take(volatile uint32_t *p, uint32_t n)
+{
+	uint32_t old, t;
+	do {
+		old = mem_ldrex(p);
+		t = (old < n) ? old : n;
+	} while (mem_strex(old - t, p));
+	return t;
+}
+
+// adds 1 if below limit
+static inline int mem_give(volatile uint32_t *p, uint32_t limit)
+{
+	uint32_t old;
+	do {
+		old = mem_ldrex(p);
+		if (old >= limit) {
+			mem_clrex();
+			return 0;
+		}
+	} while (mem_strex(old + 1, p));
+	return 1;
+}
+
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+// adds n, returns the new value
+static inline uint32_t mem_add(volatile uint32_t *p, uint32_t n)
+{
+	uint32_t v;
+	do {
+		v = mem_ldrex(p) + n;
+	} while (mem_strex(v, p));
+	return v;
+}
+
+// stores v if larger
+static inline void mem_raise(volatile uint32_t *p, uint32_t v)
+{
+	uint32_t old;
+	do {
+		old = mem_ldrex(p);
+		if (old >= v) {
+			mem_clrex();
+			return;
+		}
+	} while (mem_strex(v, p));
+}
+#endif
+
+// clears the first set bit, returns its position or 32 if none
+static inline uint32_t mem_claim_bit(volatile uint32_t *p)
+{
+	uint32_t avail, n;
+	do {
+		avail = mem_ldrex(p);
+		if (avail == 0) {
+			mem_clrex();
+			return 32;
+		}
+		n = __builtin_clz(avail); // clz = count leading zeros
+	} while (mem_strex(avail & ~(0x80000000 >> n), p));
+	return n;
+}
+
+#else
+// Cortex-M0+ has no exclusive access, mask interrupts instead
+
+static inline uint32_t mem_fetch_or(volatile uint32_t *p, uint32_t mask)
+{
+	__disable_irq();
+	uint32_t old = *p;
+	*p = old | mask;
+	__enable_irq();
+	return old;
+}
+
+static inline uint32_t mem_fetch_and(volatile uint32_t *p, uint32_t mask)
+{
+	__disable_irq();
+	uint32_t old = *p;
+	*p = old & mask;
+	__enable_irq();
+	return old;
+}
+
+static inline uint32_t mem_take(volatile uint32_t *p, uint32_t n)
+{
+	__disable_irq();
+	uint32_t old = *p;
+	uint32_t t = (old < n) ? old : n;
+	*p = old - t;
+	__enable_irq();
+	return t;
+}
+
+static inline int mem_give(volatile uint32_t *p, uint32_t limit)
+{
+	int ok = 0;
+	__disable_irq();
+	if (*p < limit) {
+		*p = *p + 1;
+		ok = 1;
+	}
+	__enable_irq();
+	return ok;
+}
+
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+static inline uint32_t mem_add(volatile uint32_t *p, uint32_t n)
+{
+	__disable_irq();
+	uint32_t v = *p + n;
+	*p = v;
+	__enable_irq();
+	return v;
+}
+
+static inline void mem_raise(volatile uint32_t *p, uint32_t v)
+{
+	__disable_irq();
+	if (*p < v) *p = v;
+	__enable_irq();
+}
+#endif
 
+static inline uint32_t mem_claim_bit(volatile uint32_t *p)
+{
+	uint32_t avail, n;
 	__disable_irq();
-	avail = usb_buffer_available;
-	n = __builtin_clz(avail); // clz = count leading zeros
-	if (n >= NUM_USB_BUFFERS) {
+	avail = *p;
+	if (avail == 0) {
 		__enable_irq();
+		return 32;
+	}
+	n = __builtin_clz(avail);
+	*p = avail & ~(0x80000000 >> n);
+	__enable_irq();
+	return n;
+}
+#endif
+
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+static volatile uint32_t usb_mem_inuse;
+static volatile uint32_t usb_mem_high_water;
+static volatile uint32_t usb_mem_fail;
+#endif
+
+// Only called after a unit was taken, so there is a free bit somewhere.
+// A summary bit can be briefly wrong while another context is between
+// the word and summary updates; whoever notices fixes it up.
+static unsigned int usb_buffer_claim(void)
+{
+	uint32_t summary, w, n;
+
+	while (1) {
+		summary = usb_buffer_summary;
+		if (summary) {
+			w = __builtin_clz(summary);
+		} else {
+			// the context we interrupted is fixing the summary
+			for (w=0; w < USB_MEM_WORDS - 1; w++) {
+				if (usb_buffer_available[w]) break;
+			}
+		}
+		n = mem_claim_bit(&usb_buffer_available[w]);
+		if (n < 32 && usb_buffer_available[w] != 0) return w * 32 + n;
+		// took the last one or found it empty, clear the summary bit and
+		// put it back if a buffer was freed into this word meanwhile
+		mem_fetch_and(&usb_buffer_summary, ~(0x80000000 >> w));
+		if (usb_buffer_available[w]) {
+			mem_fetch_or(&usb_buffer_summary, 0x80000000 >> w);
+		}
+		if (n < 32) return w * 32 + n;
+	}
+}
+
+usb_packet_t * usb_malloc_ep(uint8_t endpoint)
+{
+	unsigned int n, owner;
+	uint8_t *p;
+
+	if (endpoint > NUM_ENDPOINTS) endpoint = 0;
+	if (endpoint && mem_take(&usb_buffer_credit[endpoint], 1)) {
+		owner = endpoint | 0x80;
+	} else if (mem_take(&usb_buffer_shared, 1)) {
+		owner = endpoint;
+	} else {
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+		mem_add(&usb_mem_fail, 1);
+#endif
 		return NULL;
 	}
+	n = usb_buffer_claim();
+	usb_buffer_owner[n] = owner;
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+	mem_raise(&usb_mem_high_water, mem_add(&usb_mem_inuse, 1));
+#endif
 	//serial_print("malloc:");
 	//serial_phex(n);
 	//serial_print("\n");
-
-	usb_buffer_available = avail & ~(0x80000000 >> n);
-	__enable_irq();
 	p = usb_buffer_memory + (n * sizeof(usb_packet_t));
 	//serial_print("malloc:");
 	//serial_phex32((int)p);
@@ -72,13 +335,43 @@ usb_packet_t * usb_malloc(void)
 	return (usb_packet_t *)p;
 }
 
+usb_packet_t * usb_malloc(void)
+{
+	return usb_malloc_ep(0);
+}
+
+// Set the number of buffers held for endpoint.  Returns 0 on success, 1
+// if not enough buffers are free.  Lowering it takes effect as reserved
+// buffers are freed.  Meant for setup code, not for concurrent use.
+int usb_mem_reserve(uint8_t endpoint, uint8_t count)
+{
+	uint32_t old, t;
+
+	if (endpoint == 0 || endpoint > NUM_ENDPOINTS) return 1;
+	old = usb_buffer_reserve[endpoint];
+	if (count > old) {
+		t = mem_take(&usb_buffer_shared, count - old);
+		if (t < count - old) {
+			while (t--) mem_give(&usb_buffer_shared, NUM_USB_BUFFERS);
+			return 1;
+		}
+		usb_buffer_reserve[endpoint] = count;
+		while (t--) mem_give(&usb_buffer_credit[endpoint], count);
+	} else if (count < old) {
+		usb_buffer_reserve[endpoint] = count;
+		t = mem_take(&usb_buffer_credit[endpoint], old - count);
+		while (t--) mem_give(&usb_buffer_shared, NUM_USB_BUFFERS);
+	}
+	return 0;
+}
+
 // for the receive endpoints to request memory
 extern uint8_t usb_rx_memory_needed;
 extern void usb_rx_memory(usb_packet_t *packet);
 
 void usb_free(usb_packet_t *p)
 {
-	unsigned int n, mask;
+	unsigned int n, w, owner;
 
 	//serial_print("free:");
 	n = ((uint8_t *)p - usb_buffer_memory) / sizeof(usb_packet_t);
@@ -86,24 +379,58 @@ void usb_free(usb_packet_t *p)
 	//serial_phex(n);
 	//serial_print("\n");
 
+	owner = usb_buffer_owner[n];
 	// if any endpoints are starving for memory to receive
 	// packets, give this memory to them immediately!
-	if (usb_rx_memory_needed && usb_configuration) {
+	// Reserved buffers go back to their endpoint instead.
+	if (usb_rx_memory_needed && usb_configuration && !(owner & 0x80)) {
+		usb_buffer_owner[n] = 0;
 		//serial_print("give to rx:");
 		//serial_phex32((int)p);
 		//serial_print("\n");
 		usb_rx_memory(p);
 		return;
 	}
-
-	mask = (0x80000000 >> n);
-	__disable_irq();
-	usb_buffer_available |= mask;
-	__enable_irq();
+	usb_buffer_owner[n] = 0;
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+	mem_add(&usb_mem_inuse, -1);
+#endif
+	w = n >> 5;
+	mem_fetch_or(&usb_buffer_available[w], 0x80000000 >> (n & 31));
+	mem_fetch_or(&usb_buffer_summary, 0x80000000 >> w);
+	// the bit is visible before the unit, so a taker always finds one
+	if (!(owner & 0x80) || !mem_give(&usb_buffer_credit[owner & 0x7F],
+	  usb_buffer_reserve[owner & 0x7F])) {
+		mem_give(&usb_buffer_shared, NUM_USB_BUFFERS);
+	}
+	// An interrupt may have found the pool empty and left a receive
+	// endpoint starving after the check above.  Nothing else retries,
+	// so feed it from the pool now that the buffer is back.
+	if (usb_rx_memory_needed && usb_configuration) {
+		p = usb_malloc();
+		if (p) usb_rx_memory(p);
+	}
 
 	//serial_print("free:");
 	//serial_phex32((int)p);
 	//serial_print("\n");
 }
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+// Buffers handed to receive endpoints by usb_free still count as in use.
+void usb_mem_telemetry(usb_mem_telemetry_t *t)
+{
+	t->in_use = usb_mem_inuse;
+	t->high_water = usb_mem_high_water;
+	t->malloc_fail = usb_mem_fail;
+	t->shared_free = usb_buffer_shared;
+}
+
+void usb_mem_telemetry_reset(void)
+{
+	usb_mem_high_water = usb_mem_inuse;
+	usb_mem_fail = 0;
+}
+#endif
+
 #endif // F_CPU >= 20 MHz && defined(NUM_ENDPOINTS)
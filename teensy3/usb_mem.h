@@ -45,8 +45,22 @@ extern "C" {
 #endif
 
 usb_packet_t * usb_malloc(void);
+usb_packet_t * usb_malloc_ep(uint8_t endpoint);
+int usb_mem_reserve(uint8_t endpoint, uint8_t count);
 void usb_free(usb_packet_t *p);
 
+#if defined(USB_TELEMETRY) && USB_TELEMETRY == 1
+typedef struct {
+	uint32_t in_use;	// buffers allocated right now
+	uint32_t high_water;	// most ever allocated since reset
+	uint32_t malloc_fail;	// usb_malloc calls that returned NULL
+	uint32_t shared_free;	// free buffers not held by reservations
+} usb_mem_telemetry_t;
+
+void usb_mem_telemetry(usb_mem_telemetry_t *t);
+void usb_mem_telemetry_reset(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -110,6 +110,22 @@ static uint8_t tx_noautoflush=0;
 // search the name to find it.  This data format is shown on page 16 in Figure #8.
 // Byte 0 (shown on the left hand side of Figure #8) is the least significant byte
 // of this 32 bit input.
+// While a sysex message is written, full packets are collected here and
+// handed to usb_tx_chain() together.
+static usb_packet_t *tx_chain = NULL;
+static usb_packet_t *tx_chain_last = NULL;
+static uint8_t tx_chain_count = 0;
+static uint8_t tx_chain_active = 0;
+
+static void tx_chain_send(void)
+{
+	if (tx_chain) {
+		usb_tx_chain(MIDI_TX_ENDPOINT, tx_chain);
+		tx_chain = NULL;
+		tx_chain_count = 0;
+	}
+}
+
 void usb_midi_write_packed(uint32_t n)
 {
 	uint32_t index, wait_count=0;
@@ -121,10 +137,14 @@ void usb_midi_write_packed(uint32_t n)
 				//serial_print("error1\n");
                         	return;
                 	}
-                	if (usb_tx_packet_count(MIDI_TX_ENDPOINT) < TX_PACKET_LIMIT) {
+                	if (usb_tx_packet_count(MIDI_TX_ENDPOINT) + tx_chain_count < TX_PACKET_LIMIT) {
                         	tx_packet = usb_malloc();
                         	if (tx_packet) break;
                 	}
+			if (tx_chain) {
+				tx_chain_send();
+				continue;
+			}
                 	if (++wait_count > TX_TIMEOUT || transmit_previous_timeout) {
                         	transmit_previous_timeout = 1;
 				//serial_print("error2\n");
@@ -140,15 +160,27 @@ void usb_midi_write_packed(uint32_t n)
 		tx_packet->index = index;
 	} else {
 		tx_packet->len = MIDI_TX_SIZE;
-		usb_tx(MIDI_TX_ENDPOINT, tx_packet);
+		if (!tx_chain_active) {
+			usb_tx(MIDI_TX_ENDPOINT, tx_packet);
+		} else {
+			if (tx_chain) {
+				tx_chain_last->next = tx_packet;
+			} else {
+				tx_chain = tx_packet;
+			}
+			tx_chain_last = tx_packet;
+			tx_chain_count++;
+		}
 		tx_packet = NULL;
 	}
-	tx_noautoflush = 0;
+	// a partly filled packet must not be flushed ahead of the chain
+	tx_noautoflush = tx_chain_active;
 }
 
 void usb_midi_send_sysex_buffer_has_term(const uint8_t *data, uint32_t length, uint8_t cable)
 {
 	cable = (cable & 0x0F) << 4;
+	tx_chain_active = 1;
         while (length > 3) {
                 usb_midi_write_packed(0x04 | cable | (data[0] << 8) | (data[1] << 16) | (data[2] << 24));
                 data += 3;
@@ -161,6 +193,9 @@ void usb_midi_send_sysex_buffer_has_term(const uint8_t *data, uint32_t length, u
         } else if (length == 1) {
                 usb_midi_write_packed(0x05 | cable | (data[0] << 8));
         }
+	tx_chain_active = 0;
+	tx_chain_send();
+	tx_noautoflush = 0;
 }
 
 void usb_midi_send_sysex_add_term_bytes(const uint8_t *data, uint32_t length, uint8_t cable)
@@ -173,11 +208,11 @@ void usb_midi_send_sysex_add_term_bytes(const uint8_t *data, uint32_t length, ui
 	} else if (length == 1) {
 		usb_midi_write_packed(0x07 | cable | (0xF0 << 8) | (data[0] << 16) | (0xF7 << 24));
 		return;
-	} else {
-		usb_midi_write_packed(0x04 | cable | (0xF0 << 8) | (data[0] << 16) | (data[1] << 24));
-		data += 2;
-		length -= 2;
 	}
+	tx_chain_active = 1;
+	usb_midi_write_packed(0x04 | cable | (0xF0 << 8) | (data[0] << 16) | (data[1] << 24));
+	data += 2;
+	length -= 2;
 	while (length >= 3) {
 		usb_midi_write_packed(0x04 | cable | (data[0] << 8) | (data[1] << 16) | (data[2] << 24));
 		data += 3;
@@ -190,6 +225,9 @@ void usb_midi_send_sysex_add_term_bytes(const uint8_t *data, uint32_t length, ui
 	} else {
                 usb_midi_write_packed(0x05 | cable | (0xF7 << 8));
 	}
+	tx_chain_active = 0;
+	tx_chain_send();
+	tx_noautoflush = 0;
 }
 
 void usb_midi_flush_output(void)
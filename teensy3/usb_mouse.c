@@ -30,6 +30,7 @@
 
 #include "usb_dev.h"
 #include "usb_mouse.h"
+#include "usb_hid_sched.h"
 #include "core_pins.h" // for yield()
 #include "HardwareSerial.h"
 #include <string.h> // for memcpy()
@@ -143,6 +144,114 @@ static uint8_t transmit_previous_timeout=0;
 #endif
 
 
+#if defined(USB_HID_SCHEDULER) && USB_HID_SCHEDULER == 1
+// Relative motion is summed until the next SOF, then sent in steps of at
+// most 127.  The absolute position is only sent as its latest value.
+static int16_t mouse_acc_x, mouse_acc_y, mouse_acc_wheel, mouse_acc_horiz;
+static uint8_t mouse_buttons_pending, mouse_buttons_sent;
+static uint8_t mouse_move_pending, mouse_position_pending;
+
+static int8_t mouse_take(int16_t *acc)
+{
+	int16_t n = *acc;
+
+	if (n > 127) n = 127;
+	else if (n < -127) n = -127;
+	*acc -= n;
+	return n;
+}
+
+static int16_t mouse_add(int16_t acc, int8_t n)
+{
+	int32_t sum = acc + n;
+
+	if (sum > 32767) return 32767;
+	if (sum < -32767) return -32767;
+	return sum;
+}
+
+static uint32_t mouse_build(usb_hid_slot_t *slot, uint8_t *buf)
+{
+	uint32_t val32;
+
+	if (mouse_move_pending) {
+		buf[0] = 1;
+		buf[1] = mouse_buttons_pending;
+		buf[2] = mouse_take(&mouse_acc_x);
+		buf[3] = mouse_take(&mouse_acc_y);
+		buf[4] = mouse_take(&mouse_acc_wheel);
+		buf[5] = mouse_take(&mouse_acc_horiz); // horizontal scroll
+		mouse_buttons_sent = mouse_buttons_pending;
+		if (mouse_acc_x || mouse_acc_y || mouse_acc_wheel || mouse_acc_horiz) {
+			slot->pending = 1;
+		} else {
+			mouse_move_pending = 0;
+		}
+		if (mouse_position_pending) slot->pending = 1;
+		return 6;
+	}
+	if (mouse_position_pending) {
+		mouse_position_pending = 0;
+		buf[0] = 2;
+		val32 = usb_mouse_position_x * usb_mouse_scale_x + usb_mouse_offset_x;
+		buf[1] = val32 >> 16;
+		buf[2] = val32 >> 24;
+		val32 = usb_mouse_position_y * usb_mouse_scale_y + usb_mouse_offset_y;
+		buf[3] = val32 >> 16;
+		buf[4] = val32 >> 24;
+		return 5;
+	}
+	return 0;
+}
+
+static usb_hid_slot_t mouse_slot = {
+	.build = mouse_build,
+	.endpoint = MOUSE_ENDPOINT
+};
+
+// Move the mouse.  x, y and wheel are -127 to 127.  Use 0 for no movement.
+int usb_mouse_move(int8_t x, int8_t y, int8_t wheel, int8_t horiz)
+{
+	uint8_t buttons = usb_mouse_buttons_state;
+
+	if (!usb_configuration) return -1;
+	if (x == -128) x = -127;
+	if (y == -128) y = -127;
+	if (wheel == -128) wheel = -127;
+	if (horiz == -128) horiz = -127;
+	// a button pressed and released before the host saw it, or the
+	// other way around, needs the pending report sent first
+	if (mouse_move_pending && ((mouse_buttons_sent ^ mouse_buttons_pending)
+	  & (mouse_buttons_pending ^ buttons))) {
+		if (usb_hid_flush(&mouse_slot)) return -1;
+	}
+	__disable_irq();
+	mouse_acc_x = mouse_add(mouse_acc_x, x);
+	mouse_acc_y = mouse_add(mouse_acc_y, y);
+	mouse_acc_wheel = mouse_add(mouse_acc_wheel, wheel);
+	mouse_acc_horiz = mouse_add(mouse_acc_horiz, horiz);
+	mouse_buttons_pending = buttons;
+	mouse_move_pending = 1;
+	__enable_irq();
+	usb_hid_post(&mouse_slot);
+	return 0;
+}
+
+int usb_mouse_position(uint16_t x, uint16_t y)
+{
+	if (!usb_configuration) return -1;
+	if (x >= usb_mouse_resolution_x) x = usb_mouse_resolution_x - 1;
+	if (y >= usb_mouse_resolution_y) y = usb_mouse_resolution_y - 1;
+	__disable_irq();
+	usb_mouse_position_x = x;
+	usb_mouse_position_y = y;
+	mouse_position_pending = 1;
+	__enable_irq();
+	usb_hid_post(&mouse_slot);
+	return 0;
+}
+
+#else
 // Move the mouse.  x, y and wheel are -127 to 127.  Use 0 for no movement.
 int usb_mouse_move(int8_t x, int8_t y, int8_t wheel, int8_t horiz)
 {
@@ -227,6 +336,7 @@ int usb_mouse_position(uint16_t x, uint16_t y)
 	usb_tx(MOUSE_ENDPOINT, tx_packet);
         return 0;
 }
+#endif // USB_HID_SCHEDULER
 
 void usb_mouse_screen_size(uint16_t width, uint16_t height, uint8_t mac)
 {
@@ -195,22 +195,33 @@ int usb_serial2_write(const void *buffer, uint32_t size)
 	uint32_t wait_count;
 	const uint8_t *src = (const uint8_t *)buffer;
 	uint8_t *dest;
+	usb_packet_t *chain = NULL, *chain_last = NULL;
+	uint32_t chain_count = 0;
 
+	// full packets are collected in chain and sent together, when
+	// this would have to wait and at the end
 	tx_noautoflush = 1;
 	while (size > 0) {
 		if (!tx_packet) {
 			wait_count = 0;
 			while (1) {
 				if (!usb_configuration) {
+					if (chain) usb_tx_chain(CDC2_TX_ENDPOINT, chain);
 					tx_noautoflush = 0;
 					return -1;
 				}
-				if (usb_tx_packet_count(CDC2_TX_ENDPOINT) < TX_PACKET_LIMIT) {
+				if (usb_tx_packet_count(CDC2_TX_ENDPOINT) + chain_count < TX_PACKET_LIMIT) {
 					tx_noautoflush = 1;
 					tx_packet = usb_malloc();
 					if (tx_packet) break;
 					tx_noautoflush = 0;
 				}
+				if (chain) {
+					usb_tx_chain(CDC2_TX_ENDPOINT, chain);
+					chain = NULL;
+					chain_count = 0;
+					continue;
+				}
 				if (++wait_count > TX_TIMEOUT || transmit_previous_timeout) {
 					transmit_previous_timeout = 1;
 					return -1;
@@ -227,11 +238,18 @@ int usb_serial2_write(const void *buffer, uint32_t size)
 		while (len-- > 0) *dest++ = *src++;
 		if (tx_packet->index >= CDC2_TX_SIZE) {
 			tx_packet->len = CDC2_TX_SIZE;
-			usb_tx(CDC2_TX_ENDPOINT, tx_packet);
+			if (chain) {
+				chain_last->next = tx_packet;
+			} else {
+				chain = tx_packet;
+			}
+			chain_last = tx_packet;
+			chain_count++;
 			tx_packet = NULL;
 		}
 		usb_cdc2_transmit_flush_timer = TRANSMIT_FLUSH_TIMEOUT;
 	}
+	if (chain) usb_tx_chain(CDC2_TX_ENDPOINT, chain);
 	tx_noautoflush = 0;
 	return ret;
 }
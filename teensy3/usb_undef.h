@@ -191,6 +191,18 @@
 #ifdef KEYBOARD_INTERVAL
 #undef KEYBOARD_INTERVAL
 #endif
+#ifdef KEYBOARD_NKRO_INTERFACE
+#undef KEYBOARD_NKRO_INTERFACE
+#endif
+#ifdef KEYBOARD_NKRO_ENDPOINT
+#undef KEYBOARD_NKRO_ENDPOINT
+#endif
+#ifdef KEYBOARD_NKRO_SIZE
+#undef KEYBOARD_NKRO_SIZE
+#endif
+#ifdef KEYBOARD_NKRO_INTERVAL
+#undef KEYBOARD_NKRO_INTERVAL
+#endif
 #ifdef MOUSE_INTERFACE
 #undef MOUSE_INTERFACE
 #endif
@@ -308,6 +320,9 @@
 #ifdef DS4_TX_SIZE
 #undef DS4_TX_SIZE
 #endif
+#ifdef DS4_TX_RESERVE
+#undef DS4_TX_RESERVE
+#endif
 #ifdef DS4_TX_INTERVAL
 #undef DS4_TX_INTERVAL
 #endif
@@ -97,6 +97,13 @@ public:
 	void update(double microseconds) {
 		return update((float)microseconds);
 	}
+	// start the current period over, cheap enough for other interrupts
+	void restart() {
+		if (channel) {
+			channel->TCTRL = 0;
+			channel->TCTRL = 3;
+		}
+	}
 	void end();
 	void priority(uint8_t n) {
 		nvic_priority = n;
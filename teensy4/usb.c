@@ -11,6 +11,7 @@
 #include "usb_touch.h"
 #include "usb_midi.h"
 #include "usb_audio.h"
+#include "usb_ds4.h"
 #include "core_pins.h" // for delay()
 #include "avr/pgmspace.h"
 #include <string.h>
@@ -343,6 +344,9 @@ static void isr(void)
 		#ifdef FLIGHTSIM_INTERFACE
 		usb_flightsim_flush_output();
 		#endif
+		#ifdef DS4_INTERFACE
+		usb_ds4_sof_callback();
+		#endif
 	}
 }
 
@@ -455,6 +459,9 @@ static void endpoint0_setup(uint64_t setupdata)
 		#if defined(AUDIO_INTERFACE)
 		usb_audio_configure();
 		#endif
+		#if defined(DS4_INTERFACE)
+		usb_ds4_configure();
+		#endif
 		endpoint0_receive(NULL, 0, 0);
 		return;
 	  case 0x0880: // GET_CONFIGURATION
@@ -568,6 +575,15 @@ static void endpoint0_setup(uint64_t setupdata)
 #endif
 #if defined(SEREMU_INTERFACE) || defined(KEYBOARD_INTERFACE)
 	  case 0x0921: // HID SET_REPORT
+		#if defined(DS4_INTERFACE)
+		if (setup.wIndex == DS4_INTERFACE) {
+			// auth challenge pages are too large for endpoint0_buffer
+			if (setup.wLength > sizeof(usb_ds4_reply_buffer)) break;
+			endpoint0_setupdata.bothwords = setup.bothwords;
+			endpoint0_receive(usb_ds4_reply_buffer, setup.wLength, 1);
+			return;
+		}
+		#endif
 		if (setup.wLength <= sizeof(endpoint0_buffer)) {
 			//printf("hid set report %x %x\n", setup.word1, setup.word2);
 			endpoint0_setupdata.bothwords = setup.bothwords;
@@ -577,6 +593,18 @@ static void endpoint0_setup(uint64_t setupdata)
 		}
 		break;
 #endif
+#if defined(DS4_INTERFACE)
+	  case 0x01A1: // HID GET_REPORT
+		if (setup.wIndex == DS4_INTERFACE) {
+			const uint8_t *data;
+			uint32_t datalen;
+			if (usb_ds4_on_get_report(&setup, &data, &datalen)) break;
+			if (datalen > setup.wLength) datalen = setup.wLength;
+			endpoint0_transmit(data, datalen, 0);
+			return;
+		}
+		break;
+#endif
 #if defined(AUDIO_INTERFACE)
 	  case 0x0B01: // SET_INTERFACE (alternate setting)
 		if (setup.wIndex == AUDIO_INTERFACE+1) {
@@ -774,6 +802,11 @@ static void endpoint0_complete(void)
 		usb_reboot_timer = 80; // TODO: 10 if only 12 Mbit/sec
 	}
 #endif
+#ifdef DS4_INTERFACE
+	if (setup.wRequestAndType == 0x0921 && setup.wIndex == DS4_INTERFACE) {
+		usb_ds4_on_set_report(&setup, usb_ds4_reply_buffer);
+	}
+#endif
 #ifdef AUDIO_INTERFACE
 	if (setup.word1 == 0x02010121 /* TODO: check setup.word2 */) {
 		usb_audio_set_feature(&endpoint0_setupdata, endpoint0_buffer);
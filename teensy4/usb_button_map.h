@@ -0,0 +1,136 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2017 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef USBbuttonmap_h_
+#define USBbuttonmap_h_
+
+#ifdef __cplusplus
+
+#include <inttypes.h>
+
+// Compile time mapping from a word of physical inputs (bit n = input n, in
+// whatever order the sketch scans its pins) to the button bits of a HID
+// report. Each template argument is the report bit for that input, or one of
+// the special values below. For example
+//
+//   typedef usb_button_map<DS4_BTN_CROSS, DS4_BTN_CIRCLE,
+//       USB_BUTTON_MAP_HAT_UP, USB_BUTTON_MAP_HAT_DOWN> pad_map;
+//   DS4.setButtons<pad_map>(inputs);
+//
+// Inputs that share the same distance to their report bit are moved with a
+// single mask and shift, so pins wired in report order cost one AND.
+#define USB_BUTTON_MAP_NONE		0xFF
+#define USB_BUTTON_MAP_HAT_UP		0xF0
+#define USB_BUTTON_MAP_HAT_RIGHT	0xF1
+#define USB_BUTTON_MAP_HAT_DOWN		0xF2
+#define USB_BUTTON_MAP_HAT_LEFT		0xF3
+// Returned by hat() when no direction (or only opposing ones) is pressed
+#define USB_BUTTON_MAP_HAT_CENTER	8
+
+template <class Map, int D> struct usb_button_map_move;
+
+template <uint8_t... Pos>
+class usb_button_map
+{
+public:
+	static constexpr unsigned int count = sizeof...(Pos);
+	static_assert(count <= 32, "usb_button_map takes at most 32 inputs");
+
+	// Report bits written by buttons()
+	static constexpr uint32_t outputMask(void) {
+		const uint8_t pos[] = {Pos..., USB_BUTTON_MAP_NONE};
+		uint32_t mask = 0;
+		for (unsigned int i=0; i < count; i++) {
+			if (pos[i] < 32) mask |= (uint32_t)1 << pos[i];
+		}
+		return mask;
+	}
+	// Inputs which move by delta bits to reach their report bit
+	static constexpr uint32_t deltaMask(int delta) {
+		const uint8_t pos[] = {Pos..., USB_BUTTON_MAP_NONE};
+		uint32_t mask = 0;
+		for (unsigned int i=0; i < count; i++) {
+			if (pos[i] < 32 && (int)pos[i] - (int)i == delta) mask |= (uint32_t)1 << i;
+		}
+		return mask;
+	}
+	// Inputs mapped to a hat direction
+	static constexpr uint32_t hatMask(uint8_t dir) {
+		const uint8_t pos[] = {Pos..., USB_BUTTON_MAP_NONE};
+		uint32_t mask = 0;
+		for (unsigned int i=0; i < count; i++) {
+			if (pos[i] == dir) mask |= (uint32_t)1 << i;
+		}
+		return mask;
+	}
+	static constexpr bool hasHat(void) {
+		return (hatMask(USB_BUTTON_MAP_HAT_UP) | hatMask(USB_BUTTON_MAP_HAT_RIGHT)
+			| hatMask(USB_BUTTON_MAP_HAT_DOWN) | hatMask(USB_BUTTON_MAP_HAT_LEFT)) != 0;
+	}
+
+	// Report button bits for a word of inputs
+	static inline uint32_t buttons(uint32_t inputs) {
+		return usb_button_map_move<usb_button_map, -31>::apply(inputs);
+	}
+	// Hat position, 0 = N, 1 = NE ... 7 = NW, or USB_BUTTON_MAP_HAT_CENTER
+	static inline uint8_t hat(uint32_t inputs) {
+		// index bits: up, right, down, left
+		static const uint8_t table[16] = {8, 0, 2, 1, 4, 8, 3, 2, 6, 7, 8, 0, 5, 6, 4, 8};
+		uint32_t index = ((inputs & hatMask(USB_BUTTON_MAP_HAT_UP)) ? 1 : 0)
+			| ((inputs & hatMask(USB_BUTTON_MAP_HAT_RIGHT)) ? 2 : 0)
+			| ((inputs & hatMask(USB_BUTTON_MAP_HAT_DOWN)) ? 4 : 0)
+			| ((inputs & hatMask(USB_BUTTON_MAP_HAT_LEFT)) ? 8 : 0);
+		return table[index];
+	}
+};
+
+// Moves the inputs that are D bits away from their report bit, then recurses
+// for D + 1. Masks are constant, so empty steps compile away.
+template <class Map, int D>
+struct usb_button_map_move
+{
+	static inline uint32_t apply(uint32_t inputs) {
+		constexpr uint32_t mask = Map::deltaMask(D);
+		uint32_t out = 0;
+		if (mask) out = (D >= 0) ? (inputs & mask) << (D >= 0 ? D : 0)
+			: (inputs & mask) >> (D < 0 ? -D : 0);
+		return out | usb_button_map_move<Map, D + 1>::apply(inputs);
+	}
+};
+
+template <class Map>
+struct usb_button_map_move<Map, 32>
+{
+	static inline uint32_t apply(uint32_t inputs) { return 0; }
+};
+
+#endif // __cplusplus
+
+#endif // USBbuttonmap_h_
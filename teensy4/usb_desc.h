@@ -912,6 +912,46 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define ENDPOINT14_CONFIG	ENDPOINT_TRANSMIT_ISOCHRONOUS
   #define ENDPOINT15_CONFIG	ENDPOINT_TRANSMIT_ONLY
 
+#elif defined(USB_DS4)
+  #define VENDOR_ID		0x16C0
+  // Same PID as on Teensy 3.x, see teensy3/usb_desc.h
+  #define PRODUCT_ID		0x04D5
+  #define MANUFACTURER_NAME	{'T','e','e','n','s','y','d','u','i','n','o'}
+  #define MANUFACTURER_NAME_LEN	11
+  #define PRODUCT_NAME		{'T','e','e','n','s','y',' ','D','S','4'}
+  #define PRODUCT_NAME_LEN	10
+  #define EP0_SIZE		64
+  #define NUM_ENDPOINTS         4
+  #define NUM_INTERFACE		2
+  #define DS4_INTERFACE      0	// DS4
+  #define DS4_TX_ENDPOINT    3
+  #define DS4_TX_SIZE        64
+  #define DS4_RX_ENDPOINT    4
+  #define DS4_RX_SIZE        64
+  // DS4_*_INTERVAL is in frames (12 Mbit/sec), DS4_*_INTERVAL_480 is the
+  // 2^(n-1) microframe encoding used at 480 Mbit/sec
+  #if defined(USB_DS4_TURBO) && USB_DS4_TURBO == 1
+    #define DS4_TX_INTERVAL    1
+    #define DS4_RX_INTERVAL    1
+    #define DS4_TX_INTERVAL_480 4	// 1 ms
+    #define DS4_RX_INTERVAL_480 4
+  #else
+    #define DS4_TX_INTERVAL    5
+    #define DS4_RX_INTERVAL    5
+    #define DS4_TX_INTERVAL_480 6	// 4 ms, closest to 5 ms without going over
+    #define DS4_RX_INTERVAL_480 6
+  #endif
+  #define SEREMU_INTERFACE      1	// Serial emulation
+  #define SEREMU_TX_ENDPOINT    2
+  #define SEREMU_TX_SIZE        64
+  #define SEREMU_TX_INTERVAL    1
+  #define SEREMU_RX_ENDPOINT    2
+  #define SEREMU_RX_SIZE        32
+  #define SEREMU_RX_INTERVAL    2
+  #define ENDPOINT2_CONFIG	ENDPOINT_RECEIVE_INTERRUPT + ENDPOINT_TRANSMIT_INTERRUPT
+  #define ENDPOINT3_CONFIG	ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
+  #define ENDPOINT4_CONFIG	ENDPOINT_RECEIVE_INTERRUPT + ENDPOINT_TRANSMIT_UNUSED
+
 #endif
 
 #ifdef USB_DESC_LIST_DEFINE
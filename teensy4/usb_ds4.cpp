@@ -0,0 +1,1540 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2017 PJRC.COM, LLC.
+ * Copyright (c) 2018-2019 dogtopus
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "usb_dev.h"
+#include "usb_ds4.h"
+#include "avr/pgmspace.h" // for PROGMEM, DMAMEM, FASTRUN
+#include "core_pins.h" // for yield()
+#include "HardwareSerial.h"
+#include "IntervalTimer.h"
+#include "EventResponder.h"
+#include <string.h> // for memcpy()
+#include <stddef.h> // for offsetof()
+
+#if defined(DS4_INTERFACE) && defined(USB_DS4)
+
+
+#ifndef DS4_PACKET_TIMEOUT
+#define DS4_PACKET_TIMEOUT 1000
+#endif
+
+#if defined(DS4_DEBUG_INFO) && DS4_DEBUG_INFO == 1
+#define debug_print(args) serial_print(args)
+#define debug_phex(args) serial_phex(args)
+#define debug_phex16(args) serial_phex16(args)
+#define debug_phex32(args) serial_phex32(args)
+#else
+#define debug_print(args) while (0) {}
+#define debug_phex(args) while (0) {}
+#define debug_phex16(args) while (0) {}
+#define debug_phex32(args) while (0) {}
+#endif
+
+// Was ripped from GIMX HoriPad emulation firmware, now ripped from Hori Mini
+// packet capture, with patched feature bits.
+// (The philosophical question is, since it seems that the only reason why a
+// Hori Mini behaves like a Hori Mini is because of the feature bits, are we
+// still emulating a Hori Mini if the feature bits got patched?)
+// Anyway this seems to be a configuration that used by DS4 to determine what
+// hardware are available on the controller (byte 5) and what type of controller
+// it is (byte 6).
+static const uint8_t replay_report_0x03[] = {
+    0x03, 0x21, 0x27, 0x04, 0x4d, 0x00, 0x2c, 0x56,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x0d, 0x0d, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+// Response when PS4 asks for resetting the security chip used in authentication
+// process.
+static const uint8_t replay_report_0xf3[] = {
+    0xf3, 0x00, 0x38, 0x38, 0x00, 0x00, 0x00, 0x00
+};
+
+// Used by usb.c as a extended buffer for feature reports. Lives in DTCM like
+// endpoint0_buffer, so no cache maintenance is needed around EP0 transfers.
+uint8_t usb_ds4_reply_buffer[64] __attribute__ ((aligned(32)));
+
+// Authentication state. Challenge pages flow from the USB ISR to the sketch,
+// response pages the other way. Both directions use single producer, single
+// consumer rings so neither side has to mask interrupts; each index is only
+// ever written by one side.
+#define AUTH_QUEUE_MASK (DS4_AUTH_QUEUE_SIZE - 1)
+#if (DS4_AUTH_QUEUE_SIZE & AUTH_QUEUE_MASK) != 0
+#error "DS4_AUTH_QUEUE_SIZE must be a power of 2"
+#endif
+#define AUTH_CHALLENGE_MASK (DS4_AUTH_CHALLENGE_QUEUE_SIZE - 1)
+#if (DS4_AUTH_CHALLENGE_QUEUE_SIZE & AUTH_CHALLENGE_MASK) != 0
+#error "DS4_AUTH_CHALLENGE_QUEUE_SIZE must be a power of 2"
+#endif
+#if DS4_AUTH_CHALLENGE_QUEUE_SIZE <= DS4_AUTH_CHALLENGE_PAGES
+#error "DS4_AUTH_CHALLENGE_QUEUE_SIZE must hold a whole challenge"
+#endif
+
+static ds4_auth_t auth_challenge_queue[DS4_AUTH_CHALLENGE_QUEUE_SIZE];
+static volatile uint8_t auth_challenge_head; // ISR
+static volatile uint8_t auth_challenge_tail; // sketch
+static ds4_auth_t auth_response_queue[DS4_AUTH_QUEUE_SIZE];
+static volatile uint8_t auth_response_head; // sketch
+static volatile uint8_t auth_response_tail; // ISR
+static volatile uint8_t auth_state;
+static volatile uint8_t auth_seq;
+static volatile uint8_t auth_generation; // bumped on every reset
+static EventResponder *auth_event = NULL;
+// Kept for the polled API
+static volatile bool auth_poll_pending;
+static volatile bool auth_response_wanted;
+static ds4_auth_t auth_legacy_challenge;
+static ds4_auth_t auth_legacy_response;
+
+#define auth_barrier() __asm__ volatile("" ::: "memory")
+
+static void auth_trigger(int status, void *data) {
+    EventResponder *event = auth_event;
+    if (event) event->triggerEvent(status, data);
+}
+
+void usb_ds4_report_init(ds4_report_t *report) {
+    memset(report, 0, sizeof(ds4_report_t));
+    report->type = 0x01;
+    // Center the D-Pad
+    DS4_DPAD_SET(report->buttons, DS4_DPAD_C);
+    // Analog sticks
+    report->analog_l_x = 0x80;
+    report->analog_l_y = 0x80;
+    report->analog_r_x = 0x80;
+    report->analog_r_y = 0x80;
+    // Ext
+    report->state_ext = DS4_EXT_NULL;
+    // Touch
+    for (uint8_t i=0; i<3; i++) {
+        report->frames[i].pos1 = DS4_TOUCH_POS_PACK(0, 0, 0, 0);
+        report->frames[i].pos2 = DS4_TOUCH_POS_PACK(0, 0, 0, 0);
+    }
+    report->battery = 0xff;
+    report->gyro_x = 0xffe7;
+    report->gyro_y = 0x206e;
+    report->gyro_z = 0x09d9;
+    //report->padding[1] = 0x80;
+}
+
+// The console expects 3/16 ticks per microsecond. Accumulating deltas keeps
+// the 16 bit counter continuous when micros() wraps. Called from send(),
+// which may also run from the frame sync interrupt.
+uint16_t usb_ds4_sensor_timestamp(void) {
+    static uint32_t last_us;
+    static uint32_t remainder;
+    static uint16_t ts;
+    uint32_t now = micros(); // masks interrupts itself, call it first
+    uint32_t delta, ticks;
+    uint16_t r;
+
+    __disable_irq();
+    delta = now - last_us;
+    if ((int32_t) delta < 0) {
+        // an interrupt took a newer timestamp since micros() above
+        delta = 0;
+        now = last_us;
+    } else if (delta > 1000000) {
+        // the 16 bit count wraps in about 350 ms, a longer gap only has
+        // to keep the multiply below from overflowing
+        delta = 1000000;
+    }
+    ticks = delta * 3 + remainder;
+    last_us = now;
+    remainder = ticks & 15;
+    ts += ticks >> 4;
+    r = ts;
+    __enable_irq();
+    return r;
+}
+
+// Drains ring into filter and writes the filtered motion into report.
+// Returns the number of samples consumed.
+int usb_ds4_imu_process(ds4_imu_ring_t *ring, ds4_imu_filter_t *filter, ds4_report_t *report) {
+    uint16_t tail = ring->tail;
+    uint16_t mask = ring->size - 1;
+    uint8_t shift = filter->shift;
+    int count = 0;
+    int i;
+
+    while (tail != ring->head) {
+        const int16_t *in = (const int16_t *) &ring->samples[tail];
+        if (!filter->primed) {
+            for (i=0; i<6; i++) filter->state[i] = (int32_t) in[i] << 8;
+            filter->primed = true;
+        } else {
+            for (i=0; i<6; i++) {
+                filter->state[i] += (((int32_t) in[i] << 8) - filter->state[i]) >> shift;
+            }
+        }
+        tail = (tail + 1) & mask;
+        count++;
+    }
+    if (count) {
+        __asm__ volatile("" ::: "memory");
+        ring->tail = tail;
+        report->accel_x = filter->state[0] >> 8;
+        report->accel_y = filter->state[1] >> 8;
+        report->accel_z = filter->state[2] >> 8;
+        report->gyro_x = filter->state[3] >> 8;
+        report->gyro_y = filter->state[4] >> 8;
+        report->gyro_z = filter->state[5] >> 8;
+    }
+    return count;
+}
+
+// Only called from the USB ISR: drops queued responses from the consumer
+// side, stale challenge pages are skipped by their seq when read.
+void usb_ds4_auth_state_init(void) {
+    auth_seq = 0;
+    auth_generation++;
+    auth_state = DS4_AUTH_IDLE;
+    auth_response_tail = auth_response_head;
+    auth_poll_pending = false;
+    auth_response_wanted = false;
+}
+
+// CRC32 (IEEE 802.3, reflected) slice-by-4 tables
+PROGMEM static const uint32_t crc32_table[4][256] = {
+    {
+        0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+        0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+        0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+        0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+        0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+        0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+        0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+        0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+        0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+        0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+        0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+        0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+        0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+        0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+        0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+        0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+        0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+        0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+        0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+        0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+        0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+        0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+        0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+        0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+        0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+        0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+        0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+        0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+        0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+        0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+        0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+        0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+        0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+        0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+        0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+        0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+        0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+        0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+        0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+        0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+        0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+        0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+        0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+    },
+    {
+        0x00000000, 0x191b3141, 0x32366282, 0x2b2d53c3, 0x646cc504, 0x7d77f445,
+        0x565aa786, 0x4f4196c7, 0xc8d98a08, 0xd1c2bb49, 0xfaefe88a, 0xe3f4d9cb,
+        0xacb54f0c, 0xb5ae7e4d, 0x9e832d8e, 0x87981ccf, 0x4ac21251, 0x53d92310,
+        0x78f470d3, 0x61ef4192, 0x2eaed755, 0x37b5e614, 0x1c98b5d7, 0x05838496,
+        0x821b9859, 0x9b00a918, 0xb02dfadb, 0xa936cb9a, 0xe6775d5d, 0xff6c6c1c,
+        0xd4413fdf, 0xcd5a0e9e, 0x958424a2, 0x8c9f15e3, 0xa7b24620, 0xbea97761,
+        0xf1e8e1a6, 0xe8f3d0e7, 0xc3de8324, 0xdac5b265, 0x5d5daeaa, 0x44469feb,
+        0x6f6bcc28, 0x7670fd69, 0x39316bae, 0x202a5aef, 0x0b07092c, 0x121c386d,
+        0xdf4636f3, 0xc65d07b2, 0xed705471, 0xf46b6530, 0xbb2af3f7, 0xa231c2b6,
+        0x891c9175, 0x9007a034, 0x179fbcfb, 0x0e848dba, 0x25a9de79, 0x3cb2ef38,
+        0x73f379ff, 0x6ae848be, 0x41c51b7d, 0x58de2a3c, 0xf0794f05, 0xe9627e44,
+        0xc24f2d87, 0xdb541cc6, 0x94158a01, 0x8d0ebb40, 0xa623e883, 0xbf38d9c2,
+        0x38a0c50d, 0x21bbf44c, 0x0a96a78f, 0x138d96ce, 0x5ccc0009, 0x45d73148,
+        0x6efa628b, 0x77e153ca, 0xbabb5d54, 0xa3a06c15, 0x888d3fd6, 0x91960e97,
+        0xded79850, 0xc7cca911, 0xece1fad2, 0xf5facb93, 0x7262d75c, 0x6b79e61d,
+        0x4054b5de, 0x594f849f, 0x160e1258, 0x0f152319, 0x243870da, 0x3d23419b,
+        0x65fd6ba7, 0x7ce65ae6, 0x57cb0925, 0x4ed03864, 0x0191aea3, 0x188a9fe2,
+        0x33a7cc21, 0x2abcfd60, 0xad24e1af, 0xb43fd0ee, 0x9f12832d, 0x8609b26c,
+        0xc94824ab, 0xd05315ea, 0xfb7e4629, 0xe2657768, 0x2f3f79f6, 0x362448b7,
+        0x1d091b74, 0x04122a35, 0x4b53bcf2, 0x52488db3, 0x7965de70, 0x607eef31,
+        0xe7e6f3fe, 0xfefdc2bf, 0xd5d0917c, 0xcccba03d, 0x838a36fa, 0x9a9107bb,
+        0xb1bc5478, 0xa8a76539, 0x3b83984b, 0x2298a90a, 0x09b5fac9, 0x10aecb88,
+        0x5fef5d4f, 0x46f46c0e, 0x6dd93fcd, 0x74c20e8c, 0xf35a1243, 0xea412302,
+        0xc16c70c1, 0xd8774180, 0x9736d747, 0x8e2de606, 0xa500b5c5, 0xbc1b8484,
+        0x71418a1a, 0x685abb5b, 0x4377e898, 0x5a6cd9d9, 0x152d4f1e, 0x0c367e5f,
+        0x271b2d9c, 0x3e001cdd, 0xb9980012, 0xa0833153, 0x8bae6290, 0x92b553d1,
+        0xddf4c516, 0xc4eff457, 0xefc2a794, 0xf6d996d5, 0xae07bce9, 0xb71c8da8,
+        0x9c31de6b, 0x852aef2a, 0xca6b79ed, 0xd37048ac, 0xf85d1b6f, 0xe1462a2e,
+        0x66de36e1, 0x7fc507a0, 0x54e85463, 0x4df36522, 0x02b2f3e5, 0x1ba9c2a4,
+        0x30849167, 0x299fa026, 0xe4c5aeb8, 0xfdde9ff9, 0xd6f3cc3a, 0xcfe8fd7b,
+        0x80a96bbc, 0x99b25afd, 0xb29f093e, 0xab84387f, 0x2c1c24b0, 0x350715f1,
+        0x1e2a4632, 0x07317773, 0x4870e1b4, 0x516bd0f5, 0x7a468336, 0x635db277,
+        0xcbfad74e, 0xd2e1e60f, 0xf9ccb5cc, 0xe0d7848d, 0xaf96124a, 0xb68d230b,
+        0x9da070c8, 0x84bb4189, 0x03235d46, 0x1a386c07, 0x31153fc4, 0x280e0e85,
+        0x674f9842, 0x7e54a903, 0x5579fac0, 0x4c62cb81, 0x8138c51f, 0x9823f45e,
+        0xb30ea79d, 0xaa1596dc, 0xe554001b, 0xfc4f315a, 0xd7626299, 0xce7953d8,
+        0x49e14f17, 0x50fa7e56, 0x7bd72d95, 0x62cc1cd4, 0x2d8d8a13, 0x3496bb52,
+        0x1fbbe891, 0x06a0d9d0, 0x5e7ef3ec, 0x4765c2ad, 0x6c48916e, 0x7553a02f,
+        0x3a1236e8, 0x230907a9, 0x0824546a, 0x113f652b, 0x96a779e4, 0x8fbc48a5,
+        0xa4911b66, 0xbd8a2a27, 0xf2cbbce0, 0xebd08da1, 0xc0fdde62, 0xd9e6ef23,
+        0x14bce1bd, 0x0da7d0fc, 0x268a833f, 0x3f91b27e, 0x70d024b9, 0x69cb15f8,
+        0x42e6463b, 0x5bfd777a, 0xdc656bb5, 0xc57e5af4, 0xee530937, 0xf7483876,
+        0xb809aeb1, 0xa1129ff0, 0x8a3fcc33, 0x9324fd72
+    },
+    {
+        0x00000000, 0x01c26a37, 0x0384d46e, 0x0246be59, 0x0709a8dc, 0x06cbc2eb,
+        0x048d7cb2, 0x054f1685, 0x0e1351b8, 0x0fd13b8f, 0x0d9785d6, 0x0c55efe1,
+        0x091af964, 0x08d89353, 0x0a9e2d0a, 0x0b5c473d, 0x1c26a370, 0x1de4c947,
+        0x1fa2771e, 0x1e601d29, 0x1b2f0bac, 0x1aed619b, 0x18abdfc2, 0x1969b5f5,
+        0x1235f2c8, 0x13f798ff, 0x11b126a6, 0x10734c91, 0x153c5a14, 0x14fe3023,
+        0x16b88e7a, 0x177ae44d, 0x384d46e0, 0x398f2cd7, 0x3bc9928e, 0x3a0bf8b9,
+        0x3f44ee3c, 0x3e86840b, 0x3cc03a52, 0x3d025065, 0x365e1758, 0x379c7d6f,
+        0x35dac336, 0x3418a901, 0x3157bf84, 0x3095d5b3, 0x32d36bea, 0x331101dd,
+        0x246be590, 0x25a98fa7, 0x27ef31fe, 0x262d5bc9, 0x23624d4c, 0x22a0277b,
+        0x20e69922, 0x2124f315, 0x2a78b428, 0x2bbade1f, 0x29fc6046, 0x283e0a71,
+        0x2d711cf4, 0x2cb376c3, 0x2ef5c89a, 0x2f37a2ad, 0x709a8dc0, 0x7158e7f7,
+        0x731e59ae, 0x72dc3399, 0x7793251c, 0x76514f2b, 0x7417f172, 0x75d59b45,
+        0x7e89dc78, 0x7f4bb64f, 0x7d0d0816, 0x7ccf6221, 0x798074a4, 0x78421e93,
+        0x7a04a0ca, 0x7bc6cafd, 0x6cbc2eb0, 0x6d7e4487, 0x6f38fade, 0x6efa90e9,
+        0x6bb5866c, 0x6a77ec5b, 0x68315202, 0x69f33835, 0x62af7f08, 0x636d153f,
+        0x612bab66, 0x60e9c151, 0x65a6d7d4, 0x6464bde3, 0x662203ba, 0x67e0698d,
+        0x48d7cb20, 0x4915a117, 0x4b531f4e, 0x4a917579, 0x4fde63fc, 0x4e1c09cb,
+        0x4c5ab792, 0x4d98dda5, 0x46c49a98, 0x4706f0af, 0x45404ef6, 0x448224c1,
+        0x41cd3244, 0x400f5873, 0x4249e62a, 0x438b8c1d, 0x54f16850, 0x55330267,
+        0x5775bc3e, 0x56b7d609, 0x53f8c08c, 0x523aaabb, 0x507c14e2, 0x51be7ed5,
+        0x5ae239e8, 0x5b2053df, 0x5966ed86, 0x58a487b1, 0x5deb9134, 0x5c29fb03,
+        0x5e6f455a, 0x5fad2f6d, 0xe1351b80, 0xe0f771b7, 0xe2b1cfee, 0xe373a5d9,
+        0xe63cb35c, 0xe7fed96b, 0xe5b86732, 0xe47a0d05, 0xef264a38, 0xeee4200f,
+        0xeca29e56, 0xed60f461, 0xe82fe2e4, 0xe9ed88d3, 0xebab368a, 0xea695cbd,
+        0xfd13b8f0, 0xfcd1d2c7, 0xfe976c9e, 0xff5506a9, 0xfa1a102c, 0xfbd87a1b,
+        0xf99ec442, 0xf85cae75, 0xf300e948, 0xf2c2837f, 0xf0843d26, 0xf1465711,
+        0xf4094194, 0xf5cb2ba3, 0xf78d95fa, 0xf64fffcd, 0xd9785d60, 0xd8ba3757,
+        0xdafc890e, 0xdb3ee339, 0xde71f5bc, 0xdfb39f8b, 0xddf521d2, 0xdc374be5,
+        0xd76b0cd8, 0xd6a966ef, 0xd4efd8b6, 0xd52db281, 0xd062a404, 0xd1a0ce33,
+        0xd3e6706a, 0xd2241a5d, 0xc55efe10, 0xc49c9427, 0xc6da2a7e, 0xc7184049,
+        0xc25756cc, 0xc3953cfb, 0xc1d382a2, 0xc011e895, 0xcb4dafa8, 0xca8fc59f,
+        0xc8c97bc6, 0xc90b11f1, 0xcc440774, 0xcd866d43, 0xcfc0d31a, 0xce02b92d,
+        0x91af9640, 0x906dfc77, 0x922b422e, 0x93e92819, 0x96a63e9c, 0x976454ab,
+        0x9522eaf2, 0x94e080c5, 0x9fbcc7f8, 0x9e7eadcf, 0x9c381396, 0x9dfa79a1,
+        0x98b56f24, 0x99770513, 0x9b31bb4a, 0x9af3d17d, 0x8d893530, 0x8c4b5f07,
+        0x8e0de15e, 0x8fcf8b69, 0x8a809dec, 0x8b42f7db, 0x89044982, 0x88c623b5,
+        0x839a6488, 0x82580ebf, 0x801eb0e6, 0x81dcdad1, 0x8493cc54, 0x8551a663,
+        0x8717183a, 0x86d5720d, 0xa9e2d0a0, 0xa820ba97, 0xaa6604ce, 0xaba46ef9,
+        0xaeeb787c, 0xaf29124b, 0xad6fac12, 0xacadc625, 0xa7f18118, 0xa633eb2f,
+        0xa4755576, 0xa5b73f41, 0xa0f829c4, 0xa13a43f3, 0xa37cfdaa, 0xa2be979d,
+        0xb5c473d0, 0xb40619e7, 0xb640a7be, 0xb782cd89, 0xb2cddb0c, 0xb30fb13b,
+        0xb1490f62, 0xb08b6555, 0xbbd72268, 0xba15485f, 0xb853f606, 0xb9919c31,
+        0xbcde8ab4, 0xbd1ce083, 0xbf5a5eda, 0xbe9834ed
+    },
+    {
+        0x00000000, 0xb8bc6765, 0xaa09c88b, 0x12b5afee, 0x8f629757, 0x37def032,
+        0x256b5fdc, 0x9dd738b9, 0xc5b428ef, 0x7d084f8a, 0x6fbde064, 0xd7018701,
+        0x4ad6bfb8, 0xf26ad8dd, 0xe0df7733, 0x58631056, 0x5019579f, 0xe8a530fa,
+        0xfa109f14, 0x42acf871, 0xdf7bc0c8, 0x67c7a7ad, 0x75720843, 0xcdce6f26,
+        0x95ad7f70, 0x2d111815, 0x3fa4b7fb, 0x8718d09e, 0x1acfe827, 0xa2738f42,
+        0xb0c620ac, 0x087a47c9, 0xa032af3e, 0x188ec85b, 0x0a3b67b5, 0xb28700d0,
+        0x2f503869, 0x97ec5f0c, 0x8559f0e2, 0x3de59787, 0x658687d1, 0xdd3ae0b4,
+        0xcf8f4f5a, 0x7733283f, 0xeae41086, 0x525877e3, 0x40edd80d, 0xf851bf68,
+        0xf02bf8a1, 0x48979fc4, 0x5a22302a, 0xe29e574f, 0x7f496ff6, 0xc7f50893,
+        0xd540a77d, 0x6dfcc018, 0x359fd04e, 0x8d23b72b, 0x9f9618c5, 0x272a7fa0,
+        0xbafd4719, 0x0241207c, 0x10f48f92, 0xa848e8f7, 0x9b14583d, 0x23a83f58,
+        0x311d90b6, 0x89a1f7d3, 0x1476cf6a, 0xaccaa80f, 0xbe7f07e1, 0x06c36084,
+        0x5ea070d2, 0xe61c17b7, 0xf4a9b859, 0x4c15df3c, 0xd1c2e785, 0x697e80e0,
+        0x7bcb2f0e, 0xc377486b, 0xcb0d0fa2, 0x73b168c7, 0x6104c729, 0xd9b8a04c,
+        0x446f98f5, 0xfcd3ff90, 0xee66507e, 0x56da371b, 0x0eb9274d, 0xb6054028,
+        0xa4b0efc6, 0x1c0c88a3, 0x81dbb01a, 0x3967d77f, 0x2bd27891, 0x936e1ff4,
+        0x3b26f703, 0x839a9066, 0x912f3f88, 0x299358ed, 0xb4446054, 0x0cf80731,
+        0x1e4da8df, 0xa6f1cfba, 0xfe92dfec, 0x462eb889, 0x549b1767, 0xec277002,
+        0x71f048bb, 0xc94c2fde, 0xdbf98030, 0x6345e755, 0x6b3fa09c, 0xd383c7f9,
+        0xc1366817, 0x798a0f72, 0xe45d37cb, 0x5ce150ae, 0x4e54ff40, 0xf6e89825,
+        0xae8b8873, 0x1637ef16, 0x048240f8, 0xbc3e279d, 0x21e91f24, 0x99557841,
+        0x8be0d7af, 0x335cb0ca, 0xed59b63b, 0x55e5d15e, 0x47507eb0, 0xffec19d5,
+        0x623b216c, 0xda874609, 0xc832e9e7, 0x708e8e82, 0x28ed9ed4, 0x9051f9b1,
+        0x82e4565f, 0x3a58313a, 0xa78f0983, 0x1f336ee6, 0x0d86c108, 0xb53aa66d,
+        0xbd40e1a4, 0x05fc86c1, 0x1749292f, 0xaff54e4a, 0x322276f3, 0x8a9e1196,
+        0x982bbe78, 0x2097d91d, 0x78f4c94b, 0xc048ae2e, 0xd2fd01c0, 0x6a4166a5,
+        0xf7965e1c, 0x4f2a3979, 0x5d9f9697, 0xe523f1f2, 0x4d6b1905, 0xf5d77e60,
+        0xe762d18e, 0x5fdeb6eb, 0xc2098e52, 0x7ab5e937, 0x680046d9, 0xd0bc21bc,
+        0x88df31ea, 0x3063568f, 0x22d6f961, 0x9a6a9e04, 0x07bda6bd, 0xbf01c1d8,
+        0xadb46e36, 0x15080953, 0x1d724e9a, 0xa5ce29ff, 0xb77b8611, 0x0fc7e174,
+        0x9210d9cd, 0x2aacbea8, 0x38191146, 0x80a57623, 0xd8c66675, 0x607a0110,
+        0x72cfaefe, 0xca73c99b, 0x57a4f122, 0xef189647, 0xfdad39a9, 0x45115ecc,
+        0x764dee06, 0xcef18963, 0xdc44268d, 0x64f841e8, 0xf92f7951, 0x41931e34,
+        0x5326b1da, 0xeb9ad6bf, 0xb3f9c6e9, 0x0b45a18c, 0x19f00e62, 0xa14c6907,
+        0x3c9b51be, 0x842736db, 0x96929935, 0x2e2efe50, 0x2654b999, 0x9ee8defc,
+        0x8c5d7112, 0x34e11677, 0xa9362ece, 0x118a49ab, 0x033fe645, 0xbb838120,
+        0xe3e09176, 0x5b5cf613, 0x49e959fd, 0xf1553e98, 0x6c820621, 0xd43e6144,
+        0xc68bceaa, 0x7e37a9cf, 0xd67f4138, 0x6ec3265d, 0x7c7689b3, 0xc4caeed6,
+        0x591dd66f, 0xe1a1b10a, 0xf3141ee4, 0x4ba87981, 0x13cb69d7, 0xab770eb2,
+        0xb9c2a15c, 0x017ec639, 0x9ca9fe80, 0x241599e5, 0x36a0360b, 0x8e1c516e,
+        0x866616a7, 0x3eda71c2, 0x2c6fde2c, 0x94d3b949, 0x090481f0, 0xb1b8e695,
+        0xa30d497b, 0x1bb12e1e, 0x43d23e48, 0xfb6e592d, 0xe9dbf6c3, 0x516791a6,
+        0xccb0a91f, 0x740cce7a, 0x66b96194, 0xde0506f1
+    }
+};
+
+uint32_t usb_ds4_crc32(uint32_t crc, const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    while (len && ((uint32_t) p & 3)) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 4) {
+        crc ^= *(const uint32_t *) p;
+        crc = crc32_table[3][crc & 0xff] ^ crc32_table[2][(crc >> 8) & 0xff] ^
+              crc32_table[1][(crc >> 16) & 0xff] ^ crc32_table[0][crc >> 24];
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+struct setup_struct {
+  union {
+   struct {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+   };
+	uint16_t wRequestAndType;
+  };
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+};
+
+// Feature report handlers. Replies are built in usb_ds4_reply_buffer unless
+// they can point straight at a static table.
+
+static int feature_get_f1(const uint8_t **reply, uint32_t *len) { // getChallengeResponse
+    ds4_auth_t *resp = (ds4_auth_t *) usb_ds4_reply_buffer;
+    debug_print("I: getChallengeResponse\n");
+    auth_poll_pending = false;
+    if (auth_response_tail != auth_response_head) {
+        uint8_t tail = auth_response_tail;
+        memcpy(resp, &auth_response_queue[tail], sizeof(ds4_auth_t));
+        auth_barrier();
+        auth_response_tail = (tail + 1) & AUTH_QUEUE_MASK;
+    } else {
+        debug_print("W: f1 off sync, feeding junk\n");
+        memset(resp, 0, sizeof(ds4_auth_t));
+    }
+    if (resp->page < 0x12) {
+        // ask for the next page while the console digests this one
+        auth_state = DS4_AUTH_RESPONDING;
+        if (auth_response_tail == auth_response_head) {
+            auth_response_wanted = true;
+            auth_trigger(DS4_AUTH_EVENT_RESPONSE_WANTED, NULL);
+        }
+    } else {
+        auth_state = DS4_AUTH_DONE;
+        auth_response_wanted = false;
+        auth_trigger(DS4_AUTH_EVENT_DONE, NULL);
+    }
+    *reply = usb_ds4_reply_buffer;
+    *len = sizeof(ds4_auth_t);
+    return 0;
+}
+
+static int feature_get_f2(const uint8_t **reply, uint32_t *len) { // challengeResponseAvailable
+    ds4_auth_result_t *result = (ds4_auth_result_t *) usb_ds4_reply_buffer;
+    debug_print("I: challengeResponseAvailable\n");
+    result->type = 0xf2;
+    result->seq = auth_seq;
+    memset(result->padding, 0, 9);
+    if (auth_response_tail == auth_response_head) {
+        result->status = 0x10;
+        // first poll after the challenge: time to sign
+        if (auth_state == DS4_AUTH_CHALLENGE) {
+            auth_state = DS4_AUTH_SIGNING;
+            auth_trigger(DS4_AUTH_EVENT_RESPONSE_WANTED, NULL);
+        }
+        auth_poll_pending = true;
+    } else {
+        result->status = 0x00;
+        auth_poll_pending = false;
+    }
+    result->crc32 = usb_ds4_crc32(0, result, offsetof(ds4_auth_result_t, crc32));
+    *reply = usb_ds4_reply_buffer;
+    *len = sizeof(ds4_auth_result_t);
+    return 0;
+}
+
+static int feature_get_f3(const uint8_t **reply, uint32_t *len) { // licensedResetAuth
+    debug_print("I: licensedResetAuth\n");
+    usb_ds4_auth_state_init();
+    auth_trigger(DS4_AUTH_EVENT_RESET, NULL);
+    *reply = replay_report_0xf3;
+    *len = sizeof(replay_report_0xf3);
+    return 0;
+}
+
+static int feature_set_f0(const uint8_t *data, uint32_t len) { // setChallenge
+    const ds4_auth_t *authbuf = (const ds4_auth_t *) data;
+    debug_print("I: setChallenge\n");
+    if (len != sizeof(ds4_auth_t)) {
+        debug_print("E: Packet len mismatch (");
+        debug_phex16(sizeof(ds4_auth_t));
+        debug_print(" != ");
+        debug_phex16(len);
+        debug_print(")\n");
+        return 1;
+    } else if (authbuf->type != 0xf0) { // magic check
+        debug_print("E: Invalid magic (0xf0 != ");
+        debug_phex16(authbuf->type);
+        debug_print(")\n");
+        return 1;
+    }
+    uint8_t head = auth_challenge_head;
+    uint8_t next = (head + 1) & AUTH_CHALLENGE_MASK;
+    if (auth_seq != authbuf->seq || authbuf->page == 0) {
+        debug_print("I: clearing state\n");
+        usb_ds4_auth_state_init();
+        auth_seq = authbuf->seq;
+    }
+    if (next == auth_challenge_tail) {
+        // Sketch isn't keeping up. Drop the page but still accept the
+        // transfer, a stall makes the console abort the exchange.
+        debug_print("W: f0 queue full, dropping\n");
+        return 0;
+    }
+    memcpy(&auth_challenge_queue[head], authbuf, sizeof(ds4_auth_t));
+    auth_barrier();
+    auth_challenge_head = next;
+    auth_state = DS4_AUTH_CHALLENGE;
+    auth_trigger(DS4_AUTH_EVENT_CHALLENGE, &auth_challenge_queue[head]);
+    return 0;
+}
+
+// Pairing state, 0x12 is served from here directly
+static ds4_pair_status_t pair_status = {
+    0x12,
+    {0x56, 0x34, 0x12, 0x00, 0x1b, 0xdc}, // device address, little endian
+    {0x08, 0x25, 0x00},
+    {0}
+};
+static uint8_t pair_link_key[16];
+
+static int feature_set_13(const uint8_t *data, uint32_t len) { // setPairing
+    const ds4_pair_t *pair = (const ds4_pair_t *) data;
+    debug_print("I: setPairing\n");
+    if (len < sizeof(ds4_pair_t)) return 1;
+    memcpy(pair_status.host_bdaddr, pair->host_bdaddr, 6);
+    memcpy(pair_link_key, pair->link_key, 16);
+    return 0;
+}
+
+// Neutral IMU calibration: no bias, +-8192 counts full scale
+static const uint8_t replay_report_0x02[] = {
+    0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // gyro bias pitch, yaw, roll
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, // gyro plus pitch, yaw, roll
+    0x00, 0xe0, 0x00, 0xe0, 0x00, 0xe0, // gyro minus pitch, yaw, roll
+    0x1c, 0x02, 0x1c, 0x02,             // gyro speed plus, minus
+    0x00, 0x20, 0x00, 0xe0,             // accel x plus, minus
+    0x00, 0x20, 0x00, 0xe0,             // accel y plus, minus
+    0x00, 0x20, 0x00, 0xe0,             // accel z plus, minus
+    0x00, 0x00
+};
+
+static const ds4_getrevision_t replay_report_0xa3 = {
+    0xa3,
+    {
+        {'S', 'e', 'p', ' ', '2', '1', ' ', '2', '0', '1', '8', 0, 0, 0, 0, 0},
+        {'0', '4', ':', '5', '0', ':', '5', '1', 0, 0, 0, 0, 0, 0, 0, 0},
+        0x0100, 0xb400, 0x00000001, 0x0a01, 0x0000, 0x00000000
+    }
+};
+
+typedef struct {
+    uint8_t id;
+    uint8_t len; // length of data
+    const void *data; // served as is, or NULL
+    int (*get)(const uint8_t **reply, uint32_t *len);
+    int (*set)(const uint8_t *data, uint32_t len);
+} feature_entry_t;
+
+// Sorted by id, looked up with a binary search from the EP0 handler
+static constexpr feature_entry_t feature_table[] = {
+    {0x02, sizeof(replay_report_0x02), replay_report_0x02, NULL, NULL}, // getCalibration
+    {0x03, sizeof(replay_report_0x03), replay_report_0x03, NULL, NULL}, // licensedGetHWConfig
+    {0x12, sizeof(ds4_pair_status_t), &pair_status, NULL, NULL}, // getPairing
+    {0x13, 0, NULL, NULL, feature_set_13}, // setPairing
+    {0xa3, sizeof(ds4_getrevision_t), &replay_report_0xa3, NULL, NULL}, // getRevision
+    {0xf0, 0, NULL, NULL, feature_set_f0},
+    {0xf1, 0, NULL, feature_get_f1, NULL},
+    {0xf2, 0, NULL, feature_get_f2, NULL},
+    {0xf3, 0, NULL, feature_get_f3, NULL},
+};
+
+#define FEATURE_COUNT (sizeof(feature_table) / sizeof(feature_entry_t))
+
+static constexpr bool feature_table_sorted(unsigned int i) {
+    return (i + 1 >= FEATURE_COUNT) ||
+        (feature_table[i].id < feature_table[i + 1].id && feature_table_sorted(i + 1));
+}
+static_assert(feature_table_sorted(0), "feature_table must be sorted by id");
+
+static const feature_entry_t *feature_find(uint16_t wValue) {
+    unsigned int lo = 0, hi = FEATURE_COUNT;
+    uint8_t id = wValue & 0xff;
+    if ((wValue >> 8) != 0x03) return NULL; // feature reports only
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) >> 1;
+        if (feature_table[mid].id == id) return &feature_table[mid];
+        if (feature_table[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+int usb_ds4_on_get_report(void *setup_ptr, const uint8_t **data, uint32_t *len) {
+    struct setup_struct setup = *((struct setup_struct *)setup_ptr);
+    const feature_entry_t *f = feature_find(setup.wValue);
+    if (f && f->get) {
+        if (f->get(data, len)) return 1;
+    } else if (f && f->data) {
+        *data = (const uint8_t *) f->data;
+        *len = f->len;
+    } else {
+        debug_print("W: Unknown get_report ");
+        debug_phex16(setup.wValue);
+        debug_print("\n");
+        return 1;
+    }
+    debug_print("I: Get report OK\n");
+    return 0;
+}
+
+int usb_ds4_on_set_report(void *setup_ptr, uint8_t *data) {
+    struct setup_struct setup = *((struct setup_struct *)setup_ptr);
+    const feature_entry_t *f = feature_find(setup.wValue);
+    if (!f || !f->set) {
+        debug_print("W: Unknown set_report ");
+        debug_phex16(setup.wValue);
+        debug_print("\n");
+        return 1;
+    }
+    if (f->set(data, setup.wLength)) return 1;
+    debug_print("I: Set report OK\n");
+    return 0;
+}
+
+void usb_ds4_class::setDeviceAddress(const uint8_t *bdaddr) {
+    __disable_irq();
+    memcpy(pair_status.deivce_bdaddr, bdaddr, 6);
+    __enable_irq();
+}
+
+bool usb_ds4_class::getPairing(ds4_pair_t *pair) {
+    bool paired;
+    __disable_irq();
+    pair->type = 0x13;
+    memcpy(pair->host_bdaddr, pair_status.host_bdaddr, 6);
+    memcpy(pair->link_key, pair_link_key, 16);
+    paired = memcmp(pair_status.host_bdaddr, "\0\0\0\0\0\0", 6) != 0;
+    __enable_irq();
+    return paired;
+}
+
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+// Latency tracing. Every queued report gets a FIFO slot holding the time its
+// oldest unsent input change happened and the time it was handed to
+// usb_transmit(), slots are retired in order as TX transfers complete.
+#define TRACE_FIFO_SIZE 8
+
+typedef struct {
+    uint32_t input_ts;
+    uint32_t tx_ts;
+    bool has_input;
+} trace_slot_t;
+
+static trace_slot_t trace_fifo[TRACE_FIFO_SIZE];
+static uint8_t trace_fifo_head, trace_fifo_tail;
+static uint32_t trace_input_ts;
+static bool trace_input_pending;
+static ds4_trace_stat_t trace_stats[DS4_TRACE_NUM_STAGES];
+
+static void trace_record(uint8_t stage, uint32_t ticks) {
+    ds4_trace_stat_t *stat = &trace_stats[stage];
+    uint32_t bucket = ticks / DS4_TRACE_TICKS_PER_US / DS4_TRACE_BUCKET_US;
+
+    if (bucket >= DS4_TRACE_BUCKETS) bucket = DS4_TRACE_BUCKETS - 1;
+    if (stat->hist[bucket] < 0xffff) stat->hist[bucket]++;
+    if (stat->count == 0 || ticks < stat->min_ticks) stat->min_ticks = ticks;
+    if (ticks > stat->max_ticks) stat->max_ticks = ticks;
+    stat->sum_ticks += ticks;
+    stat->count++;
+}
+
+void usb_ds4_trace_input(void) {
+    uint32_t now = DS4_TRACE_NOW();
+    __disable_irq();
+    if (!trace_input_pending) {
+        trace_input_ts = now;
+        trace_input_pending = true;
+    }
+    __enable_irq();
+}
+
+// Right before usb_transmit() hands a new report to the endpoint
+static void trace_handoff(void) {
+    uint32_t now = DS4_TRACE_NOW();
+    uint8_t head;
+    __disable_irq();
+    head = (trace_fifo_head + 1) % TRACE_FIFO_SIZE;
+    if (head != trace_fifo_tail) {
+        trace_fifo[trace_fifo_head].input_ts = trace_input_ts;
+        trace_fifo[trace_fifo_head].tx_ts = now;
+        trace_fifo[trace_fifo_head].has_input = trace_input_pending;
+        trace_fifo_head = head;
+    }
+    if (trace_input_pending) {
+        trace_record(DS4_TRACE_INPUT_TO_TX, now - trace_input_ts);
+        trace_input_pending = false;
+    }
+    __enable_irq();
+}
+
+// Called from the DS4_TX_ENDPOINT transfer complete callback
+void usb_ds4_trace_tx_complete(void) {
+    uint32_t now = DS4_TRACE_NOW();
+    trace_slot_t *slot;
+    if (trace_fifo_head == trace_fifo_tail) return;
+    slot = &trace_fifo[trace_fifo_tail];
+    trace_fifo_tail = (trace_fifo_tail + 1) % TRACE_FIFO_SIZE;
+    trace_record(DS4_TRACE_TX_TO_WIRE, now - slot->tx_ts);
+    if (slot->has_input) {
+        trace_record(DS4_TRACE_INPUT_TO_WIRE, now - slot->input_ts);
+    }
+}
+
+void usb_ds4_trace_reset(void) {
+    __disable_irq();
+    memset(trace_stats, 0, sizeof(trace_stats));
+    trace_fifo_head = trace_fifo_tail = 0;
+    trace_input_pending = false;
+    __enable_irq();
+}
+
+int usb_ds4_trace_get(uint8_t stage, ds4_trace_stat_t *stat) {
+    if (stage >= DS4_TRACE_NUM_STAGES) return 1;
+    __disable_irq();
+    memcpy(stat, &trace_stats[stage], sizeof(ds4_trace_stat_t));
+    __enable_irq();
+    return 0;
+}
+
+uint32_t usb_ds4_trace_mean_us(const ds4_trace_stat_t *stat) {
+    if (stat->count == 0) return 0;
+    return (uint32_t) (stat->sum_ticks / stat->count) / DS4_TRACE_TICKS_PER_US;
+}
+
+// Upper edge of the histogram bucket containing the given percentile
+uint32_t usb_ds4_trace_percentile_us(const ds4_trace_stat_t *stat, uint8_t percent) {
+    uint32_t target, seen = 0;
+    uint32_t total = 0;
+    int i;
+    for (i=0; i<DS4_TRACE_BUCKETS; i++) total += stat->hist[i];
+    if (total == 0) return 0;
+    target = (total * percent + 99) / 100;
+    for (i=0; i<DS4_TRACE_BUCKETS; i++) {
+        seen += stat->hist[i];
+        if (seen >= target) break;
+    }
+    if (i >= DS4_TRACE_BUCKETS) i = DS4_TRACE_BUCKETS - 1;
+    return (i + 1) * DS4_TRACE_BUCKET_US;
+}
+
+void usb_ds4_trace_print(void) {
+    static const char * const names[DS4_TRACE_NUM_STAGES] = {
+        "input->tx", "tx->wire", "input->wire"
+    };
+    ds4_trace_stat_t stat;
+    uint8_t i;
+    for (i=0; i<DS4_TRACE_NUM_STAGES; i++) {
+        usb_ds4_trace_get(i, &stat);
+        serial_print(names[i]);
+        serial_print(": n=");
+        serial_phex32(stat.count);
+        serial_print(" min=");
+        serial_phex32(stat.min_ticks / DS4_TRACE_TICKS_PER_US);
+        serial_print(" mean=");
+        serial_phex32(usb_ds4_trace_mean_us(&stat));
+        serial_print(" max=");
+        serial_phex32(stat.max_ticks / DS4_TRACE_TICKS_PER_US);
+        serial_print(" p50=");
+        serial_phex32(usb_ds4_trace_percentile_us(&stat, 50));
+        serial_print(" p99=");
+        serial_phex32(usb_ds4_trace_percentile_us(&stat, 99));
+        serial_print(" (us)\n");
+    }
+}
+#else
+#define trace_handoff() while (0) {}
+#endif
+
+// Report recording and replay, see ds4_recorder_t for the format
+#define RECORD_KEYFRAME 0xff
+// Gaps longer than this are waited out with delay() before spinning
+#define REPLAY_SPIN_MAX_US 100000
+
+#define REPLAY_NOW() ARM_DWT_CYCCNT
+#define REPLAY_TICKS_PER_US (F_CPU_ACTUAL / 1000000)
+
+static ds4_recorder_t * volatile recorder = NULL;
+
+void usb_ds4_record_init(ds4_recorder_t *rec, void *buf, uint32_t size) {
+    memset(rec, 0, sizeof(ds4_recorder_t));
+    rec->buf = (uint8_t *) buf;
+    rec->size = size;
+}
+
+int usb_ds4_record_report(ds4_recorder_t *rec, const ds4_report_t *report, uint32_t us) {
+    uint8_t out[5 + 1 + 1 + sizeof(ds4_report_t)];
+    const uint8_t *cur = (const uint8_t *) report;
+    const uint8_t *prev = (const uint8_t *) &rec->prev;
+    uint32_t dt = rec->count ? us - rec->last_us : 0;
+    uint32_t n = 0, runs_at, runs = 0;
+    uint32_t i = 0, start;
+
+    do {
+        out[n++] = (dt & 0x7f) | ((dt > 0x7f) ? 0x80 : 0);
+        dt >>= 7;
+    } while (dt);
+    runs_at = n++;
+    if (rec->count) {
+        // the counter normally just ticks, predict that
+        rec->prev.buttons[2] += 4;
+        for (i=0; i < sizeof(ds4_report_t) && n < sizeof(out) - 2; ) {
+            if (cur[i] == prev[i]) {
+                i++;
+                continue;
+            }
+            start = i;
+            while (i < sizeof(ds4_report_t) && cur[i] != prev[i]) i++;
+            out[n++] = start;
+            out[n++] = i - start;
+            while (start < i && n < sizeof(out)) out[n++] = cur[start++];
+            runs++;
+        }
+    }
+    if (!rec->count || i < sizeof(ds4_report_t) || n > runs_at + 1 + sizeof(ds4_report_t)) {
+        n = runs_at + 1;
+        memcpy(out + n, cur, sizeof(ds4_report_t));
+        n += sizeof(ds4_report_t);
+        runs = RECORD_KEYFRAME;
+    }
+    out[runs_at] = runs;
+    if (rec->len + n > rec->size) {
+        rec->prev.buttons[2] -= 4;
+        rec->dropped++;
+        return 1;
+    }
+    memcpy(rec->buf + rec->len, out, n);
+    rec->len += n;
+    rec->count++;
+    rec->last_us = us;
+    memcpy(&rec->prev, report, sizeof(ds4_report_t));
+    return 0;
+}
+
+void usb_ds4_record_attach(ds4_recorder_t *rec) {
+    recorder = rec;
+}
+
+static volatile bool record_busy;
+static volatile uint32_t record_missed;
+
+// Right before a report is handed to the endpoint. The encode runs with
+// interrupts enabled; a handoff from an interrupt that lands in the middle
+// of another one is counted as dropped instead.
+static void record_handoff(const void *report) {
+    ds4_recorder_t *rec = recorder;
+    if (!rec) return;
+    __disable_irq();
+    if (record_busy) {
+        record_missed++;
+        __enable_irq();
+        return;
+    }
+    record_busy = true;
+    __enable_irq();
+    usb_ds4_record_report(rec, (const ds4_report_t *) report, micros());
+    __disable_irq();
+    rec->dropped += record_missed;
+    record_missed = 0;
+    record_busy = false;
+    __enable_irq();
+}
+
+void usb_ds4_replay_init(ds4_player_t *player, const void *buf, uint32_t len) {
+    player->buf = (const uint8_t *) buf;
+    player->len = len;
+    player->pos = 0;
+    usb_ds4_report_init(&player->report);
+}
+
+// Decodes the next record into player->report. Returns 1 at the end of the
+// log or on a malformed record.
+int usb_ds4_replay_next(ds4_player_t *player, uint32_t *dt_us) {
+    const uint8_t *p = player->buf;
+    uint32_t pos = player->pos, len = player->len;
+    uint32_t dt = 0, shift = 0, runs, off, run;
+    uint8_t *report = (uint8_t *) &player->report;
+
+    do {
+        if (pos >= len || shift > 28) return 1;
+        dt |= (uint32_t) (p[pos] & 0x7f) << shift;
+        shift += 7;
+    } while (p[pos++] & 0x80);
+    if (pos >= len) return 1;
+    runs = p[pos++];
+    if (runs == RECORD_KEYFRAME) {
+        if (pos + sizeof(ds4_report_t) > len) return 1;
+        memcpy(report, p + pos, sizeof(ds4_report_t));
+        pos += sizeof(ds4_report_t);
+    } else {
+        player->report.buttons[2] += 4;
+        while (runs--) {
+            if (pos + 2 > len) return 1;
+            off = p[pos++];
+            run = p[pos++];
+            if (off + run > sizeof(ds4_report_t) || pos + run > len) return 1;
+            memcpy(report + off, p + pos, run);
+            pos += run;
+        }
+    }
+    player->pos = pos;
+    if (dt_us) *dt_us = dt;
+    return 0;
+}
+
+// Sends a recorded log with the original spacing, paced on the cycle
+// counter. Blocks until done, returns the number of reports sent or -1 if
+// USB went away.
+int usb_ds4_replay(const void *buf, uint32_t len) {
+    ds4_player_t player;
+    uint32_t dt, due;
+    int sent = 0;
+
+    usb_ds4_replay_init(&player, buf, len);
+    due = REPLAY_NOW();
+    while (usb_ds4_replay_next(&player, &dt) == 0) {
+        if (dt > REPLAY_SPIN_MAX_US) {
+            delay(dt / 1000);
+            due = REPLAY_NOW() + (dt % 1000) * REPLAY_TICKS_PER_US;
+        } else {
+            due += dt * REPLAY_TICKS_PER_US;
+        }
+        while ((int32_t) (due - REPLAY_NOW()) > 0) ;
+        if (usb_ds4_send_report(&player.report, false) == -1) return -1;
+        sent++;
+    }
+    return sent;
+}
+
+// Ported from usb_rawhid.c. Reports are double buffered: while the
+// controller owns one transfer the next report is prepared in the other.
+#define TX_NUM   2
+static transfer_t tx_transfer[TX_NUM] __attribute__ ((used, aligned(32)));
+DMAMEM static uint8_t txbuffer[DS4_TX_SIZE * TX_NUM] __attribute__ ((aligned(32)));
+static uint8_t tx_head=0;
+static volatile uint8_t tx_busy; // transfers owned by the controller
+
+#define RX_NUM  2
+static transfer_t rx_transfer[RX_NUM] __attribute__ ((used, aligned(32)));
+DMAMEM static uint8_t rx_buffer[DS4_RX_SIZE * RX_NUM] __attribute__ ((aligned(32)));
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_tail;
+static uint8_t rx_list[RX_NUM + 1];
+static void rx_queue_transfer(int i);
+static void rx_event(transfer_t *t);
+static void tx_event(transfer_t *t);
+extern volatile uint8_t usb_configuration;
+
+void usb_ds4_configure(void)
+{
+	memset(tx_transfer, 0, sizeof(tx_transfer));
+	memset(rx_transfer, 0, sizeof(rx_transfer));
+	tx_head = 0;
+	tx_busy = 0;
+	rx_head = 0;
+	rx_tail = 0;
+	usb_config_tx(DS4_TX_ENDPOINT, DS4_TX_SIZE, 0, tx_event);
+	usb_config_rx(DS4_RX_ENDPOINT, DS4_RX_SIZE, 0, rx_event);
+	int i;
+	for (i=0; i < RX_NUM; i++) rx_queue_transfer(i);
+}
+
+static void rx_queue_transfer(int i)
+{
+	void *buffer = rx_buffer + i * DS4_RX_SIZE;
+	arm_dcache_delete(buffer, DS4_RX_SIZE);
+	NVIC_DISABLE_IRQ(IRQ_USB1);
+	usb_prepare_transfer(rx_transfer + i, buffer, DS4_RX_SIZE, i);
+	usb_receive(DS4_RX_ENDPOINT, rx_transfer + i);
+	NVIC_ENABLE_IRQ(IRQ_USB1);
+}
+
+// Both run from run_callbacks() in the USB interrupt
+static void rx_event(transfer_t *t)
+{
+	int i = t->callback_param;
+	uint32_t len = DS4_RX_SIZE - ((t->status >> 16) & 0x7FFF);
+	if (usb_ds4_feedback_isr(rx_buffer + i * DS4_RX_SIZE, len)) {
+		// parsed in place, give the buffer straight back
+		rx_queue_transfer(i);
+		return;
+	}
+	uint32_t head = rx_head;
+	if (++head > RX_NUM) head = 0;
+	rx_list[head] = i;
+	rx_head = head;
+}
+
+static void tx_event(transfer_t *t)
+{
+	if (tx_busy) tx_busy--;
+#if defined(DS4_TRACE) && DS4_TRACE == 1
+	usb_ds4_trace_tx_complete();
+#endif
+}
+
+static int usb_ds4_recv(void *buffer)
+{
+	uint32_t tail = rx_tail;
+	if (!usb_configuration) return -1;
+	if (tail == rx_head) return 0;
+	if (++tail > RX_NUM) tail = 0;
+	uint32_t i = rx_list[tail];
+	rx_tail = tail;
+	memcpy(buffer, rx_buffer + i * DS4_RX_SIZE, DS4_RX_SIZE);
+	rx_queue_transfer(i);
+	return DS4_RX_SIZE;
+}
+
+static int usb_ds4_available(void)
+{
+	if (!usb_configuration) return 0;
+	if (rx_head != rx_tail) return DS4_RX_SIZE;
+	return 0;
+}
+
+static int usb_ds4_send(const void *buffer, uint16_t len, uint32_t timeout, bool async) {
+	transfer_t *xfer = tx_transfer + tx_head;
+	uint32_t begin = millis();
+
+	while (1) {
+		if (!usb_configuration) return -1;
+		// tx_busy is only decremented by tx_event(), no descriptor polling
+		if (tx_busy < TX_NUM) break;
+		if (async) return 0;
+		if (millis() - begin > timeout) {
+		    debug_print("send: timeout\n");
+		    return 0;
+		}
+		yield();
+	}
+	uint8_t *txdata = txbuffer + (tx_head * DS4_TX_SIZE);
+	memcpy(txdata, buffer, len);
+	arm_dcache_flush_delete(txdata, DS4_TX_SIZE);
+	usb_prepare_transfer(xfer, txdata, len, 0);
+	trace_handoff();
+	record_handoff(buffer);
+	__disable_irq();
+	tx_busy++;
+	__enable_irq();
+	usb_transmit(DS4_TX_ENDPOINT, xfer);
+	if (++tx_head >= TX_NUM) tx_head = 0;
+	return len;
+}
+
+int usb_ds4_send_report(const ds4_report_t *report, bool async) {
+    int result = usb_ds4_send((const void *) report, sizeof(ds4_report_t), DS4_PACKET_TIMEOUT, async);
+    if (result == sizeof(ds4_report_t)) {
+        return 0;
+    } else if (result == -1) {
+        return -1;
+    } else {
+        return 1;
+    }
+}
+
+// Compares only what the console acts upon: sticks, buttons (minus the report
+// counter), triggers and the latest touch contacts. Unused frame slots repeat
+// the newest, so that's always frames[2]; frame counts, sequence numbers and
+// older snapshots moving on alone don't count. Timestamps and motion are
+// ignored, see usb_ds4_motion_changed() for the latter.
+int usb_ds4_report_changed(const ds4_report_t *a, const ds4_report_t *b) {
+    if (memcmp(&a->analog_l_x, &b->analog_l_x, 6)) return 1;
+    if ((a->buttons[2] ^ b->buttons[2]) & 0x03) return 1;
+    if (a->trigger_l != b->trigger_l || a->trigger_r != b->trigger_r) return 1;
+    if (a->frames[2].pos1 != b->frames[2].pos1 || a->frames[2].pos2 != b->frames[2].pos2) return 1;
+    return 0;
+}
+
+static inline int motion_axis_changed(int16_t a, int16_t b, uint16_t threshold) {
+    int32_t d = (int32_t) a - b;
+    return d > threshold || d < -(int32_t) threshold;
+}
+
+// Returns 1 if any gyro or accel axis differs by more than threshold.
+int usb_ds4_motion_changed(const ds4_report_t *a, const ds4_report_t *b, uint16_t threshold) {
+    return motion_axis_changed(a->accel_x, b->accel_x, threshold)
+        || motion_axis_changed(a->accel_y, b->accel_y, threshold)
+        || motion_axis_changed(a->accel_z, b->accel_z, threshold)
+        || motion_axis_changed(a->gyro_x, b->gyro_x, threshold)
+        || motion_axis_changed(a->gyro_y, b->gyro_y, threshold)
+        || motion_axis_changed(a->gyro_z, b->gyro_z, threshold);
+}
+
+// The EHCI style controller may have fetched a primed transfer's buffer
+// already, so a queued report can't be safely rewritten here.
+int usb_ds4_replace_report(const ds4_report_t *report) {
+    return 0;
+}
+
+// Interrupt driven feedback. The ISR builds the next snapshot in the back
+// buffer, then flips and bumps the sequence number; readers retry their copy
+// if the sequence moved underneath them.
+static ds4_feedback_t feedback_snapshot[2];
+static volatile uint8_t feedback_front;
+static volatile uint32_t feedback_seq;
+static volatile bool feedback_enabled;
+static volatile usb_ds4_feedback_callback_t feedback_callback = NULL;
+static EventResponder *feedback_event = NULL;
+
+void usb_ds4_feedback_enable(bool enable) {
+    feedback_enabled = enable;
+}
+
+void usb_ds4_feedback_attach(usb_ds4_feedback_callback_t callback) {
+    __disable_irq();
+    feedback_callback = callback;
+    __enable_irq();
+}
+
+// Called from the USB interrupt for every OUT packet. Returns 1 if the packet
+// was consumed, 0 to leave it queued for usb_ds4_recv_feedback().
+int usb_ds4_feedback_isr(const uint8_t *data, uint32_t len) {
+    const ds4_feedback_t *in = (const ds4_feedback_t *) data;
+    const ds4_feedback_t *cur;
+    ds4_feedback_t *next;
+    uint8_t changed = 0;
+    uint8_t back;
+
+    if (!feedback_enabled) return 0;
+    if (len < sizeof(ds4_feedback_t) || in->type != 0x05) return 1;
+    cur = &feedback_snapshot[feedback_front];
+    if ((in->flags & DS4_FEEDBACK_RUMBLE) &&
+            (in->rumble_right != cur->rumble_right || in->rumble_left != cur->rumble_left)) {
+        changed |= DS4_FEEDBACK_RUMBLE;
+    }
+    if ((in->flags & DS4_FEEDBACK_LED) && memcmp(in->led_color, cur->led_color, 3)) {
+        changed |= DS4_FEEDBACK_LED;
+    }
+    if ((in->flags & DS4_FEEDBACK_FLASH) &&
+            (in->led_flash_on != cur->led_flash_on || in->led_flash_off != cur->led_flash_off)) {
+        changed |= DS4_FEEDBACK_FLASH;
+    }
+    // the first valid report is always published so hasValidFeedback() flips
+    if (!changed && cur->type == 0x05) return 1;
+
+    back = feedback_front ^ 1;
+    next = &feedback_snapshot[back];
+    *next = *cur;
+    next->type = in->type;
+    next->flags = in->flags;
+    if (changed & DS4_FEEDBACK_RUMBLE) {
+        next->rumble_right = in->rumble_right;
+        next->rumble_left = in->rumble_left;
+    }
+    if (changed & DS4_FEEDBACK_LED) {
+        memcpy(next->led_color, in->led_color, 3);
+    }
+    if (changed & DS4_FEEDBACK_FLASH) {
+        next->led_flash_on = in->led_flash_on;
+        next->led_flash_off = in->led_flash_off;
+    }
+    __asm__ volatile("" ::: "memory");
+    feedback_front = back;
+    feedback_seq++;
+
+    usb_ds4_feedback_callback_t callback = feedback_callback;
+    if (callback) (*callback)(next, changed);
+    EventResponder *event = feedback_event;
+    if (event) event->triggerEvent(changed, next);
+    return 1;
+}
+
+// Copies the latest snapshot if it's newer than *seq. Lock free, only
+// retries when the ISR published while copying.
+bool usb_ds4_feedback_snapshot(ds4_feedback_t *feedback, uint32_t *seq) {
+    uint32_t s;
+    do {
+        s = feedback_seq;
+        if (s == *seq) return false;
+        __asm__ volatile("" ::: "memory");
+        memcpy(feedback, &feedback_snapshot[feedback_front], sizeof(ds4_feedback_t));
+        __asm__ volatile("" ::: "memory");
+    } while (s != feedback_seq);
+    *seq = s;
+    return true;
+}
+
+void usb_ds4_class::attachFeedbackEvent(EventResponder &event) {
+    __disable_irq();
+    feedback_event = &event;
+    __enable_irq();
+    usb_ds4_feedback_enable(true);
+}
+
+void usb_ds4_class::detachFeedback(void) {
+    usb_ds4_feedback_enable(false);
+    __disable_irq();
+    feedback_callback = NULL;
+    feedback_event = NULL;
+    __enable_irq();
+}
+
+int usb_ds4_recv_feedback(ds4_feedback_t *feedback) {
+    int available = usb_ds4_available();
+    uint8_t recv_buffer[DS4_RX_SIZE];
+    if (available != 0) {
+        debug_phex32(available);
+        debug_print("\n");
+    }
+    if (available >= (int) sizeof(ds4_feedback_t)) {
+        int result = usb_ds4_recv((void *) &recv_buffer);
+        if (result > 0) {
+            if (recv_buffer[0] == 0x05) {
+                debug_print("I: report ok\n");
+                memcpy((void *) feedback, (const void *) recv_buffer, sizeof(ds4_feedback_t));
+                for (int i=0; i<32; i++) {
+                    debug_phex(recv_buffer[i]);
+                    if (i == 15) {
+                        debug_print("\n");
+                    } else {
+                        debug_print(" ");
+                    }
+                }
+                debug_print("\n");
+            } else {
+                debug_print("E: unknown OUT report");
+                debug_phex(recv_buffer[0]);
+                debug_print("\n");
+                return 1;
+            }
+        } else if (result == 0) {
+            debug_print("recv: no data\n");
+            return 1;
+        }
+    } else {
+        if (available > 0) {
+            debug_print("W: recv: underflow len=");
+            debug_phex32(available);
+            debug_print("\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Full speed frame length in microseconds
+#define FRAME_SYNC_PERIOD 1000
+
+static IntervalTimer frame_sync_timer;
+static void (* volatile frame_sync_sample)(void) = NULL;
+static volatile bool frame_sync_pending;
+
+extern volatile uint8_t usb_high_speed;
+
+volatile uint8_t usb_ds4_frame_sync = DS4_FRAME_SYNC_OFF;
+
+static void frame_sync_isr(void) {
+    // The PIT keeps running if SOFs stop (suspend, unplug), only sample once
+    // per frame.
+    if (!frame_sync_pending) return;
+    frame_sync_pending = false;
+    usb_ds4_frame_sync = DS4_FRAME_SYNC_SAMPLING;
+    (*frame_sync_sample)();
+    DS4.sendAsync();
+    if (frame_sync_sample) usb_ds4_frame_sync = DS4_FRAME_SYNC_ON;
+}
+
+// Called by isr() on every SOF. At 480 Mbit/sec there's one per microframe,
+// only the first of each frame restarts the PIT count, keeping its phase
+// locked to the host's frame clock.
+void usb_ds4_sof_callback(void) {
+    if (!frame_sync_sample) return;
+    if (usb_high_speed && (USB1_FRINDEX & 7)) return;
+    frame_sync_pending = true;
+    frame_sync_timer.restart();
+}
+
+bool usb_ds4_class::beginFrameSync(void (*sampleInputs)(void), uint16_t leadMicros) {
+    if (!sampleInputs || leadMicros == 0 || leadMicros >= FRAME_SYNC_PERIOD) return false;
+    // The channel is set up once here, each SOF only restarts its count.
+    if (!frame_sync_timer.begin(frame_sync_isr, FRAME_SYNC_PERIOD - leadMicros)) return false;
+    __disable_irq();
+    frame_sync_pending = false;
+    frame_sync_sample = sampleInputs;
+    usb_ds4_frame_sync = DS4_FRAME_SYNC_ON;
+    __enable_irq();
+    usb_start_sof_interrupts(DS4_INTERFACE);
+    return true;
+}
+
+void usb_ds4_class::endFrameSync(void) {
+    usb_stop_sof_interrupts(DS4_INTERFACE);
+    __disable_irq();
+    frame_sync_sample = NULL;
+    frame_sync_pending = false;
+    usb_ds4_frame_sync = DS4_FRAME_SYNC_OFF;
+    frame_sync_timer.end();
+    __enable_irq();
+}
+
+void usb_ds4_class::attachAuthEvent(EventResponder &event) {
+    __disable_irq();
+    auth_event = &event;
+    __enable_irq();
+}
+
+void usb_ds4_class::detachAuthEvent(void) {
+    __disable_irq();
+    auth_event = NULL;
+    __enable_irq();
+}
+
+uint8_t usb_ds4_class::authState(void) {
+    return auth_state;
+}
+
+static bool auth_read_challenge(ds4_auth_t *page) {
+    uint8_t tail = auth_challenge_tail;
+    while (tail != auth_challenge_head) {
+        const ds4_auth_t *slot = &auth_challenge_queue[tail];
+        bool current = (slot->seq == auth_seq);
+        if (current) memcpy(page, slot, sizeof(ds4_auth_t));
+        auth_barrier();
+        tail = (tail + 1) & AUTH_CHALLENGE_MASK;
+        auth_challenge_tail = tail;
+        // pages left over from an aborted exchange are skipped
+        if (current) return true;
+    }
+    return false;
+}
+
+bool usb_ds4_class::authReadChallenge(ds4_auth_t *page) {
+    return auth_read_challenge(page);
+}
+
+static bool auth_post_response(const ds4_auth_t *page) {
+    uint8_t head = auth_response_head;
+    uint8_t next = (head + 1) & AUTH_QUEUE_MASK;
+    if (next == auth_response_tail) return false;
+    memcpy(&auth_response_queue[head], page, sizeof(ds4_auth_t));
+    auth_barrier();
+    auth_response_head = next;
+    auth_response_wanted = false;
+    return true;
+}
+
+bool usb_ds4_class::authPostResponse(const ds4_auth_t *page) {
+    return auth_post_response(page);
+}
+
+// Polled API, kept on top of the queues above
+
+bool usb_ds4_class::authChallengeAvailable(void) {
+    uint8_t tail = auth_challenge_tail;
+    // skip stale pages so they don't show up as available
+    while (tail != auth_challenge_head && auth_challenge_queue[tail].seq != auth_seq) {
+        tail = (tail + 1) & AUTH_CHALLENGE_MASK;
+        auth_challenge_tail = tail;
+    }
+    return tail != auth_challenge_head;
+}
+
+const ds4_auth_t *usb_ds4_class::authGetChallenge(void) const {
+    auth_read_challenge(&auth_legacy_challenge);
+    return &auth_legacy_challenge;
+}
+
+// TODO rename this to authCheckNeeded or so
+bool usb_ds4_class::authChallengeSent(void) {
+    if (auth_poll_pending) {
+        auth_poll_pending = false;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+ds4_auth_t *usb_ds4_class::authGetResponseBuffer(void) {
+    return &auth_legacy_response;
+}
+
+void usb_ds4_class::authSetBufferedFlag(void) {
+    authPostResponse(&auth_legacy_response);
+}
+
+bool usb_ds4_class::authResponseAvailable(void) {
+    return auth_response_wanted;
+}
+
+// Serial auth bridge. Challenge pages are forwarded as soon as the console
+// sends them and, once the last one is out, response pages are requested
+// ahead of the console's 0xf1 reads so the queue is full when it asks.
+static HardwareSerial *bridge_port = NULL;
+static EventResponder bridge_event;
+static uint8_t bridge_generation;
+static bool bridge_prefetch;
+static uint8_t bridge_next_request; // next 0xf1 page to ask for
+static uint8_t bridge_next_response; // next 0xf1 page expected
+static uint32_t bridge_activity_ms;
+static uint8_t bridge_rx[sizeof(ds4_auth_t) + 3]; // type, len, payload, sum
+static uint8_t bridge_rx_pos; // 0 = hunting for sync
+
+static void bridge_send(uint8_t type, const void *payload, uint8_t len) {
+    uint8_t buf[sizeof(ds4_auth_t) + 4];
+    uint8_t sum = type + len;
+    buf[0] = DS4_BRIDGE_SYNC;
+    buf[1] = type;
+    buf[2] = len;
+    if (len) memcpy(buf + 3, payload, len);
+    for (uint8_t i = 0; i < len; i++) sum += buf[3 + i];
+    buf[3 + len] = -sum;
+    bridge_port->write(buf, len + 4);
+}
+
+static void bridge_frame(uint8_t type, const uint8_t *payload, uint8_t len) {
+    const ds4_auth_t *page = (const ds4_auth_t *) payload;
+    if (type != DS4_BRIDGE_RESPONSE || len != sizeof(ds4_auth_t)) return;
+    // late pages from an earlier exchange or duplicates of a retry
+    if (!bridge_prefetch || page->type != 0xf1 || page->seq != auth_seq) return;
+    if (page->page != bridge_next_response) return;
+    if (auth_post_response(page)) {
+        bridge_next_response++;
+        bridge_activity_ms = millis();
+    }
+}
+
+static void bridge_receive(void) {
+    while (bridge_port->available() > 0) {
+        uint8_t c = bridge_port->read();
+        if (bridge_rx_pos == 0) {
+            if (c == DS4_BRIDGE_SYNC) bridge_rx_pos = 1;
+            continue;
+        }
+        bridge_rx[bridge_rx_pos++ - 1] = c;
+        if (bridge_rx_pos == 3 && bridge_rx[1] > sizeof(ds4_auth_t)) {
+            bridge_rx_pos = 0; // garbage length, resync
+        } else if (bridge_rx_pos >= 3 && bridge_rx_pos == bridge_rx[1] + 4) {
+            uint8_t sum = 0;
+            for (uint8_t i = 0; i < bridge_rx_pos - 1; i++) sum += bridge_rx[i];
+            bridge_rx_pos = 0;
+            if (sum == 0) bridge_frame(bridge_rx[0], bridge_rx + 2, bridge_rx[1]);
+        }
+    }
+}
+
+static void bridge_run(EventResponderRef event) {
+    ds4_auth_t page;
+    if (!bridge_port) return;
+    if (bridge_generation != auth_generation) {
+        bridge_generation = auth_generation;
+        bridge_prefetch = false;
+        bridge_next_request = 0;
+        bridge_next_response = 0;
+        bridge_send(DS4_BRIDGE_RESET, NULL, 0);
+    }
+    while (auth_read_challenge(&page)) {
+        bridge_send(DS4_BRIDGE_CHALLENGE, &page, sizeof(ds4_auth_t));
+        if (page.page == DS4_AUTH_CHALLENGE_PAGES - 1) {
+            bridge_prefetch = true;
+            bridge_activity_ms = millis();
+        }
+    }
+    // console started polling before we saw the last page, ask anyway
+    if (!bridge_prefetch && (auth_state == DS4_AUTH_SIGNING || auth_state == DS4_AUTH_RESPONDING)) {
+        bridge_prefetch = true;
+        bridge_activity_ms = millis();
+    }
+    bridge_receive();
+    if (bridge_prefetch) {
+        uint8_t queued = (auth_response_head - auth_response_tail) & AUTH_QUEUE_MASK;
+        if (bridge_next_request != bridge_next_response &&
+            millis() - bridge_activity_ms > DS4_AUTH_BRIDGE_TIMEOUT) {
+            // a request or its response got lost, ask again
+            bridge_next_request = bridge_next_response;
+        }
+        while (bridge_next_request < DS4_AUTH_RESPONSE_PAGES &&
+               (uint8_t)(bridge_next_request - bridge_next_response) + queued < AUTH_QUEUE_MASK) {
+            uint8_t req[2] = {auth_seq, bridge_next_request++};
+            bridge_send(DS4_BRIDGE_REQUEST, req, sizeof(req));
+            bridge_activity_ms = millis();
+        }
+    }
+    // keep polling the port from yield() until the exchange is over
+    if (auth_state != DS4_AUTH_IDLE && auth_state != DS4_AUTH_DONE) event.triggerEvent();
+}
+
+void usb_ds4_class::beginAuthBridge(HardwareSerial &port, uint32_t baud) {
+    port.begin(baud);
+    bridge_rx_pos = 0;
+    bridge_generation = auth_generation - 1; // start with a reset frame
+    bridge_port = &port;
+    bridge_event.attach(bridge_run);
+    attachAuthEvent(bridge_event);
+    bridge_event.triggerEvent();
+}
+
+void usb_ds4_class::endAuthBridge(void) {
+    detachAuthEvent();
+    bridge_event.clearEvent();
+    bridge_port = NULL;
+}
+
+#endif // DS4_INTERFACE
@@ -67,6 +67,10 @@ usb_mouse_class Mouse;
 usb_rawhid_class RawHID;
 #endif
 
+#if defined(DS4_INTERFACE) && defined(USB_DS4)
+usb_ds4_class DS4;
+#endif
+
 #ifdef FLIGHTSIM_INTERFACE
 FlightSimClass FlightSim;
 #endif
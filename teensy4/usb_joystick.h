@@ -51,6 +51,8 @@ extern volatile uint8_t usb_configuration;
 
 // C++ interface
 #ifdef __cplusplus
+#include "usb_button_map.h"
+
 class usb_joystick_class
 {
         public:
@@ -121,6 +123,19 @@ class usb_joystick_class
 		usb_joystick_data[1] = (usb_joystick_data[1] & 0xFFFFFFF0) | val;
                 if (!manual_mode) usb_joystick_send();
         }
+	// Sets every button (and the hat) mentioned in Map from a word of
+	// inputs, see usb_button_map.h. Report bits are button number - 1.
+	template <class Map>
+	void buttons(uint32_t inputs) {
+		usb_joystick_data[0] = (usb_joystick_data[0] & ~Map::outputMask())
+			| Map::buttons(inputs);
+		if (Map::hasHat()) {
+			uint32_t val = Map::hat(inputs);
+			if (val == USB_BUTTON_MAP_HAT_CENTER) val = 15;
+			usb_joystick_data[1] = (usb_joystick_data[1] & 0xFFFFFFF0) | val;
+		}
+		if (!manual_mode) usb_joystick_send();
+	}
 #elif JOYSTICK_SIZE == 64
 	void button(unsigned int num, bool val) {
 		if (--num >= 128) return;
@@ -166,6 +181,19 @@ class usb_joystick_class
 		}
 		if (!manual_mode) usb_joystick_send();
         }
+	// Sets buttons 1 to 32 (and hat 1) mentioned in Map from a word of
+	// inputs, see usb_button_map.h. Report bits are button number - 1.
+	template <class Map>
+	void buttons(uint32_t inputs) {
+		usb_joystick_data[0] = (usb_joystick_data[0] & ~Map::outputMask())
+			| Map::buttons(inputs);
+		if (Map::hasHat()) {
+			uint32_t val = Map::hat(inputs);
+			if (val == USB_BUTTON_MAP_HAT_CENTER) val = 15;
+			usb_joystick_data[15] = (usb_joystick_data[15] & 0xFFF0FFFF) | (val << 16);
+		}
+		if (!manual_mode) usb_joystick_send();
+	}
 #endif
 	void useManualSend(bool mode) {
 		manual_mode = mode;